@@ -14,8 +14,36 @@
 #include <stdbool.h>
 #include <poll.h>
 #include <assert.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <time.h>
+#include <getopt.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stddef.h>
+#include <elf.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <ctype.h>
+#include <errno.h>
 
 #include "readbytes.h"
+#include "sendbytesrle.h"
+#include "sendbytescrc.h"
+#include "readbytescrc.h"
+#include "crcblocks.h"
+#include "profiler.h"
+#include "runwithinterrupts.h"
+#include "gdbmonitor.h"
+#include "sendbytesdual.h"
+#include "readbytesdual.h"
+#include "watch.h"
+#include "runtest.h"
+#include "copymemory.h"
+#include "comparememory.h"
 #include "../headers/bootloader.h"
 #include "../headers/systemcontrol.h"
 #include "../headers/gpio.h"
@@ -28,6 +56,8 @@
 #include "Musashi/m68k.h"
 
 static int uartfd;
+// uart 2 on the board, -1 unless a second device was given with -D
+static int uartfd2 = -1;
 
 #define DATABRECORDLEN(payloadlen) (8 + 2 + (payloadlen * 2) + 1 +1)
 #define BRECORDMAXPAYLOAD 0xff
@@ -35,6 +65,102 @@ static int uartfd;
 
 #define FILTERPRINTABLE(c) ((c >= 0x20 && c <= 0x7F) ? c : ' ')
 
+#define MAXBLOCKSIZE 0x7fff
+#define MAXFRAMESIZE 0x400
+
+/*
+ * Everything that depends on how the USB-serial adapter behaves, the
+ * defaults are the old hand picked values. The a command measures the link
+ * and picks new ones which are saved per adapter in LINKPARAMSFILE.
+ */
+static struct linkparams {
+	// how long the link can be quiet before we assume bytes got lost, ms
+	int timeout;
+	// chunk sizes for readmemory()/writememory(), md and ub
+	int blocksize;
+	int dumpblocksize;
+	int brecordpayload;
+	// framed transfers, frame size and how many frames writes keep in flight
+	int framesize;
+	int framewindow;
+} linkparams = { .timeout = 100, .blocksize = MAXBLOCKSIZE, .dumpblocksize =
+		256, .brecordpayload = 0xff, .framesize = 0x100, .framewindow = 2 };
+
+#define LINKPARAMSFILE ".dragonball_serialbootloader"
+
+// microseconds per byte at 115200 8N1
+#define BYTETIME 87
+
+static double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + (ts.tv_nsec / 1000000000.0);
+}
+
+/*
+ * Commands that touch the board run one after another on a worker thread so
+ * the shell can queue more of them and keep an eye on what's going on.
+ * Long running commands report their progress and check cancelrequested
+ * between blocks so a cancelled command leaves the board in the bootloader.
+ */
+#define MAXJOBS 16
+
+enum jobstate {
+	JOB_QUEUED, JOB_RUNNING, JOB_DONE, JOB_CANCELLED
+};
+
+static const char* jobstates[] = { "queued", "running", "done", "cancelled" };
+
+static struct job {
+	int id;
+	char command[256];
+	bool background;
+	enum jobstate state;
+	bool ret;
+	// what the job is doing right now and since when
+	const char* what;
+	uint32_t base;
+	uint32_t done;
+	uint32_t total;
+	double start;
+} jobs[MAXJOBS];
+
+static pthread_mutex_t jobslock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t jobscond = PTHREAD_COND_INITIALIZER;
+static int nextjobid = 1;
+static int nextjobtorun = 1;
+static struct job* currentjob = NULL;
+static volatile bool cancelrequested = false;
+
+static void printprogress(struct job* job) {
+	double elapsed = now() - job->start;
+	double rate = elapsed > 0 ? (job->done - job->base) / elapsed : 0;
+	printf("%s %"PRIu32"/%"PRIu32" bytes, %.0f bytes/s", job->what, job->done,
+			job->total, rate);
+	if (rate > 0)
+		printf(", %.0fs left", (job->total - job->done) / rate);
+}
+
+static void progress(const char* what, uint32_t done, uint32_t total) {
+	if (currentjob == NULL)
+		return;
+	pthread_mutex_lock(&jobslock);
+	if (currentjob->what != what) {
+		currentjob->what = what;
+		currentjob->base = done;
+		currentjob->start = now();
+	}
+	currentjob->done = done;
+	currentjob->total = total;
+	pthread_mutex_unlock(&jobslock);
+	// background jobs only show up in jobs so they don't trample the prompt
+	if (!currentjob->background) {
+		printf("\33[2K\r");
+		printprogress(currentjob);
+		fflush(stdout);
+	}
+}
+
 static void printblock(uint32_t offset, uint8_t* buffer, int len,
 bool printheaders) {
 	int width = 8;
@@ -151,6 +277,14 @@ static uint8_t writeuart[] = { 0x3e, 0x3c, 0x00, 0x00, //
 		0x4e, 0xf8, 0xff, 0x5a //
 		};
 
+// stubs that don't fit in the instruction buffer get loaded into the top of
+// SDRAM instead. The Makefile sets STUBAREA and where the resident stubs go
+// in it so the stubs are assembled for the same addresses.
+#ifndef STUBAREA
+#error "STUBAREA isn't set, build with the Makefile"
+#endif
+#define STUBAREASIZE (0x2000000 - STUBAREA)
+
 //static uint8_t instructionbuffertest[] = { 0x49, 0xf8, 0xf4, 0x19 };
 
 //static uint8_t instructionbuffertest[] = { 0x49, 0xf8, 0xf4, 0x19, //
@@ -159,6 +293,47 @@ static uint8_t writeuart[] = { 0x3e, 0x3c, 0x00, 0x00, //
 
 //#define PROTOCOLDEBUG
 
+/*
+ * How long the board can go quiet in the middle of something before we give
+ * up on it, long enough for cp and cmp to get through all of SDRAM.
+ */
+#define UARTSTALLTIMEOUT 10000
+
+static int uartstalltimeout() {
+	int timeout = linkparams.timeout * 10;
+	return timeout > UARTSTALLTIMEOUT ? timeout : UARTSTALLTIMEOUT;
+}
+
+// cancel the job so it unwinds instead of hanging on a link that's dead
+static void giveup(const char* why) {
+	printf("%s\n", why);
+	cancelrequested = true;
+}
+
+/*
+ * Wait for something to read. If the board has been quiet since lastheard
+ * for too long or the uart has gone away the job is given up on. A job that
+ * has already been cancelled stops waiting as soon as the link goes quiet.
+ */
+static bool waituart(struct pollfd* uartpollfd, double lastheard) {
+	while (true) {
+		int r = poll(uartpollfd, 1, linkparams.timeout);
+		if ((r > 0 && (uartpollfd->revents & (POLLHUP | POLLERR | POLLNVAL)))
+				|| (r < 0 && errno != EINTR)) {
+			giveup("uart has gone away");
+			return false;
+		}
+		if (r > 0)
+			return true;
+		if (cancelrequested)
+			return false;
+		if ((now() - lastheard) * 1000 > uartstalltimeout()) {
+			giveup("no response from the board");
+			return false;
+		}
+	}
+}
+
 static uint8_t writeandreadbackwithdifference(int uartfd, char* buff, int len,
 		int readbackdifference, uint8_t* outputbuff, int inputlen,
 		uint8_t* inputbuff) {
@@ -166,7 +341,10 @@ static uint8_t writeandreadbackwithdifference(int uartfd, char* buff, int len,
 	// if we have an input buffer we need to save the last char for later
 	int amounttowrite = (inputlen > 0) ? len - 1 : len;
 	int wrote = write(uartfd, buff, amounttowrite);
-	assert(wrote == amounttowrite);
+	if (wrote != amounttowrite) {
+		giveup("uart has gone away");
+		return 0;
+	}
 
 #ifdef PROTOCOLDEBUG
 	printf("wrote: %s\n", buff);
@@ -182,13 +360,16 @@ static uint8_t writeandreadbackwithdifference(int uartfd, char* buff, int len,
 	int r = 0;
 
 	struct pollfd uartpollfd;
-	uartpollfd.fd = 0;
+	uartpollfd.fd = uartfd;
 	uartpollfd.events = POLLIN;
 
+	double lastheard = now();
 	while (totalread < totalneeded) {
-		poll(&uartpollfd, 1, 10);
+		if (!waituart(&uartpollfd, lastheard))
+			break;
 		if ((r = read(uartfd, &(c[totalread]), totalneeded - totalread)) > 0) {
 			totalread += r;
+			lastheard = now();
 #ifdef PROTOCOLDEBUG
 			c[totalread] = '\0';
 			printf("read %d of %d\n", totalread, totalneeded);
@@ -199,16 +380,19 @@ static uint8_t writeandreadbackwithdifference(int uartfd, char* buff, int len,
 			if ((totalread == (len - 1)) && (inputlen > 0)) {
 				sleep(2);
 				for (int i = 0; i < inputlen; i++) {
-					write(uartfd, inputbuff + 1, 1);
+					write(uartfd, inputbuff + i, 1);
 					usleep(50000);
 				}
 				// write the last char of the command
 				write(uartfd, &buff[len - 1], 1);
+				lastheard = now();
 			}
 		}
 	}
 
 	c[totalread] = '\0';
+	if (totalread < totalneeded)
+		return 0;
 
 	if (readbackdifference > 0 && outputbuff != NULL) {
 		memcpy(outputbuff, &(c[len - 1]), readbackdifference);
@@ -276,7 +460,7 @@ static void clearinstructionbuffer(int uartfd) {
 
 static void loadinstructionsintomemory(int uartfd, uint32_t loadaddress,
 		uint8_t* buffer, int len) {
-	char buff[256];
+	char buff[BIGGESTBRECORD];
 	if (loadaddress == INSTRUCTIONBUFFER) {
 		if (len > INSTRUCTIONBUFFERSZ) {
 			printf("instruction buffer is too long\n");
@@ -307,9 +491,553 @@ static void runinstructionbuffer(int uartfd, int returnlen, uint8_t* outputbuff,
 			inputlen, inputbuff);
 }
 
+// returns false if the job got cancelled before all of it arrived
+static bool readuart(int uartfd, uint8_t* buff, int len) {
+	struct pollfd uartpollfd;
+	uartpollfd.fd = uartfd;
+	uartpollfd.events = POLLIN;
+
+	int totalread = 0;
+	double lastheard = now();
+	while (totalread < len) {
+		if (!waituart(&uartpollfd, lastheard))
+			return false;
+		int r = read(uartfd, buff + totalread, len - totalread);
+		if (r > 0) {
+			totalread += r;
+			lastheard = now();
+		}
+	}
+	return true;
+}
+
+// returns how many bytes arrived before the link went quiet for timeout ms
+static int readuarttimeout(int uartfd, uint8_t* buff, int len, int timeout) {
+	struct pollfd uartpollfd;
+	uartpollfd.fd = uartfd;
+	uartpollfd.events = POLLIN;
+
+	int totalread = 0;
+	while (totalread < len) {
+		if (poll(&uartpollfd, 1, timeout) <= 0
+				|| (uartpollfd.revents & (POLLHUP | POLLERR | POLLNVAL)))
+			break;
+		int r = read(uartfd, buff + totalread, len - totalread);
+		if (r > 0)
+			totalread += r;
+	}
+	return totalread;
+}
+
+static void drainuart(int uartfd, int timeout) {
+	uint8_t buff[64];
+	while (readuarttimeout(uartfd, buff, sizeof(buff), timeout) > 0)
+		;
+}
+
+/*
+ * For stubs that produce a variable amount of output. This sends the execute
+ * record minus the newline and eats the echo so the caller can consume the
+ * stub's output itself, finishinstructionsinmemory() then sends the newline
+ * and eats the last echo once the stub has jumped back into the bootloader.
+ */
+static void startinstructionsinmemory(int uartfd, uint32_t loadaddress) {
+	char buff[64];
+	int len = createbrecord_execute(buff, loadaddress);
+	int wrote = write(uartfd, buff, len - 1);
+	if (wrote != len - 1) {
+		giveup("uart has gone away");
+		return;
+	}
+	readuart(uartfd, (uint8_t*) buff, len - 1);
+}
+
+static void finishinstructionsinmemory(int uartfd) {
+	uint8_t c;
+	write(uartfd, "\n", 1);
+	readuart(uartfd, &c, 1);
+}
+
+static void putword(uint8_t* buffer, uint16_t word) {
+	buffer[0] = (word >> 8) & 0xff;
+	buffer[1] = word & 0xff;
+}
+
+static void putlong(uint8_t* buffer, uint32_t lon) {
+	buffer[0] = (lon >> 24) & 0xff;
+	buffer[1] = (lon >> 16) & 0xff;
+	buffer[2] = (lon >> 8) & 0xff;
+	buffer[3] = lon & 0xff;
+}
+
+static uint16_t getword(const uint8_t* buffer) {
+	return (buffer[0] << 8) | buffer[1];
+}
+
+static uint32_t getlong(const uint8_t* buffer) {
+	return (buffer[0] << 24) | (buffer[1] << 16) | (buffer[2] << 8) | buffer[3];
+}
+
+// what is currently sitting in STUBAREA, reset before each command as the
+// command might overwrite it
+static uint8_t* loadedstub = NULL;
+
+/*
+ * Load a stub into STUBAREA if it isn't already there. Returns false if the
+ * stub was already loaded and the caller needs to patch in its parameters
+ * with patchstub().
+ */
+static bool loadstub(int uartfd, uint8_t* stub, int len) {
+	if (loadedstub == stub)
+		return false;
+	loadinstructionsintomemory(uartfd, STUBAREA, stub, len);
+	loadedstub = stub;
+	return true;
+}
+
+static bool instubarea(uint32_t address, uint32_t len) {
+	return len > 0 && address < STUBAREA + STUBAREASIZE
+			&& (uint64_t) address + len > STUBAREA;
+}
+
+/*
+ * Writes that go through the stubs can't land on them. Returns false and
+ * says why if address and len overlap STUBAREA.
+ */
+static bool checkstubarea(uint32_t address, uint32_t len) {
+	if (!instubarea(address, len))
+		return true;
+	printf("0x%"PRIx32" - 0x%"PRIx32" overlaps the stubs at 0x%x - 0x%x\n",
+			address, address + len, STUBAREA, STUBAREA + STUBAREASIZE);
+	return false;
+}
+
+// plain b-record writes can go anywhere but have to forget the stub they hit
+static void stubareawritten(uint32_t address, uint32_t len) {
+	if (instubarea(address, len))
+		loadedstub = NULL;
+}
+
+// send the bytes from start up to end again after their values were changed
+static void patchstub(int uartfd, uint8_t* stub, int start, int end) {
+	char buff[64];
+	int len = end - start;
+	assert(len <= 16);
+	int buflen = createbrecord(buff, STUBAREA + start, len, stub + start);
+	writeandreadback(uartfd, buff, buflen);
+}
+
+static bool rlereadback = false;
+
+/*
+ * Returns false if the run lengths don't add up to the block, a corrupted
+ * count byte, in which case the rest of the stub's output is dropped and the
+ * block needs to be read again another way.
+ */
+static bool readmemoryblock_rle(int uartfd, uint32_t address, int len,
+		uint8_t* dest) {
+	assert(len <= MAXBLOCKSIZE);
+	uint8_t* stub = _binary_stub_sendbytesrle_start;
+	putword(&stub[SENDBYTESRLE_LEN], len);
+	putlong(&stub[SENDBYTESRLE_ADDRESS], address);
+	if (!loadstub(uartfd, stub, sizeof(_binary_stub_sendbytesrle_start)))
+		patchstub(uartfd, stub, SENDBYTESRLE_LEN, SENDBYTESRLE_ADDRESS + 4);
+
+	startinstructionsinmemory(uartfd, STUBAREA);
+	int prev = -1;
+	int pos = 0;
+	while (pos < len) {
+		uint8_t b;
+		readuart(uartfd, &b, 1);
+		dest[pos++] = b;
+		// a byte twice in a row is followed by the number of extra repeats
+		if (b == prev) {
+			uint8_t count;
+			readuart(uartfd, &count, 1);
+			if (pos + count > len) {
+				drainuart(uartfd, linkparams.timeout);
+				finishinstructionsinmemory(uartfd);
+				return false;
+			}
+			memset(dest + pos, b, count);
+			pos += count;
+			prev = -1;
+		} else
+			prev = b;
+	}
+	finishinstructionsinmemory(uartfd);
+	return true;
+}
+
+#define FRAMERETRIES 4
+
+static bool framedtransfers = false;
+
+static uint16_t crc16(uint16_t crc, uint8_t* data, int len) {
+	for (int i = 0; i < len; i++) {
+		crc ^= data[i] << 8;
+		for (int b = 0; b < 8; b++)
+			crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+	}
+	return crc;
+}
+
+static int framelen(int len, int frame) {
+	int remaining = len - (frame * linkparams.framesize);
+	return remaining > linkparams.framesize ? linkparams.framesize : remaining;
+}
+
+/*
+ * Stream frames first to last and mark the ones that arrive intact as good.
+ * A frame with a bad CRC is just skipped over but if bytes go missing or the
+ * sequence number is off we've lost our place so the rest of the stream is
+ * dropped and those frames get picked up on the next pass.
+ */
+static void readframes(int uartfd, uint32_t address, int len, uint8_t* dest,
+		int first, int last, bool* good) {
+	uint32_t start = first * linkparams.framesize;
+	uint32_t end = (last * linkparams.framesize) + framelen(len, last);
+	uint8_t* stub = _binary_stub_sendbytescrc_start;
+	putword(&stub[SENDBYTESCRC_LEN], end - start);
+	putlong(&stub[SENDBYTESCRC_ADDRESS], address + start);
+	putword(&stub[SENDBYTESCRC_FRAMESIZE], linkparams.framesize);
+	if (!loadstub(uartfd, stub, sizeof(_binary_stub_sendbytescrc_start)))
+		patchstub(uartfd, stub, SENDBYTESCRC_LEN, SENDBYTESCRC_FRAMESIZE + 2);
+
+	startinstructionsinmemory(uartfd, STUBAREA);
+	uint8_t frame[1 + MAXFRAMESIZE + 2];
+	for (int f = first; f <= last; f++) {
+		int flen = framelen(len, f);
+		int got = readuarttimeout(uartfd, frame, flen + 3, linkparams.timeout);
+		if (got != flen + 3 || frame[0] != ((f - first) & 0xff)) {
+			drainuart(uartfd, linkparams.timeout);
+			break;
+		}
+		uint16_t crc = (frame[flen + 1] << 8) | frame[flen + 2];
+		if (crc16(0xffff, frame, flen + 1) == crc) {
+			memcpy(dest + (f * linkparams.framesize), frame + 1, flen);
+			good[f] = true;
+		}
+	}
+	finishinstructionsinmemory(uartfd);
+}
+
+/*
+ * Push the readbytescrc stub through to its end with the count bytes it
+ * could still be waiting for and check the bootloader is back. Filler the
+ * stub doesn't need gets echoed as blank lines, those are thrown away as it
+ * goes so they can't back up.
+ */
+static bool finishframes(int uartfd, int count) {
+	char filler[64];
+	uint8_t echoes[256];
+	memset(filler, '\n', sizeof(filler));
+	while (count > 0) {
+		int w = write(uartfd, filler,
+				count > sizeof(filler) ? sizeof(filler) : count);
+		if (w <= 0)
+			break;
+		count -= w;
+		readuarttimeout(uartfd, echoes, sizeof(echoes), 0);
+	}
+	// the stub can still be a frame behind once the filler has gone out
+	tcdrain(uartfd);
+	drainuart(uartfd, linkparams.timeout
+			+ ((linkparams.framesize * BYTETIME) / 1000));
+
+	uint8_t c;
+	write(uartfd, "\n", 1);
+	if (readuarttimeout(uartfd, &c, 1, linkparams.timeout) != 1) {
+		printf("board stopped responding during framed write\n");
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Send frames first to last and mark the ones the board got intact as good.
+ * If bytes go missing the stub is left waiting part way through a frame, so
+ * the next frame or some filler is sent to push it through. The filler only
+ * lands in frames that are already bad and will get sent again.
+ *
+ * The stub sends back each frame's sequence number and CRC once it has the
+ * whole frame, so once all but one of those bytes are back it has finished
+ * and no more filler is sent. The filler is a newline, so if the
+ * stub has already finished anyway the bootloader just echoes a blank line
+ * and the echoes get drained at the end.
+ *
+ * If an ack byte goes missing the acks after it can't be matched up with
+ * their frames, and if the board stops answering the stub could be anywhere
+ * in the stream. Either way the stub is pushed through to its end and the
+ * frames it hasn't acked get picked up on the next pass. Returns false if
+ * the bootloader doesn't come back after that.
+ */
+#define FRAMEACKLEN 3
+#define FRAMEMAXFILLERS 16
+
+static bool writeframes(int uartfd, uint32_t address, int len, uint8_t* src,
+		int first, int last, bool* good) {
+	uint32_t start = first * linkparams.framesize;
+	uint32_t end = (last * linkparams.framesize) + framelen(len, last);
+	uint8_t* stub = _binary_stub_readbytescrc_start;
+	putword(&stub[READBYTESCRC_LEN], end - start);
+	putlong(&stub[READBYTESCRC_ADDRESS], address + start);
+	putword(&stub[READBYTESCRC_FRAMESIZE], linkparams.framesize);
+	if (!loadstub(uartfd, stub, sizeof(_binary_stub_readbytescrc_start)))
+		patchstub(uartfd, stub, READBYTESCRC_LEN, READBYTESCRC_FRAMESIZE + 2);
+
+	startinstructionsinmemory(uartfd, STUBAREA);
+	int frames = (last - first) + 1;
+	int sent = 0;
+	int acked = 0;
+	int fillers = 0;
+	int ackbytes = 0;
+	// how much the stub has acked, it's taken exactly that many bytes
+	uint32_t consumed = 0;
+	uint8_t ack[FRAMEACKLEN];
+	int acklen = 0;
+	bool lost = false;
+	while (acked < frames) {
+		while (sent < frames && (sent - acked) < linkparams.framewindow) {
+			int f = first + sent;
+			write(uartfd, src + (f * linkparams.framesize), framelen(len, f));
+			sent++;
+		}
+
+		// the ack can't come back before the frames ahead of it are sent
+		int pending = 0;
+		for (int f = first + acked; f < first + sent; f++)
+			pending += framelen(len, f);
+		int got = readuarttimeout(uartfd, ack + acklen, FRAMEACKLEN - acklen,
+				linkparams.timeout + ((pending * BYTETIME) / 1000));
+		acklen += got;
+		ackbytes += got;
+		if (acklen == FRAMEACKLEN) {
+			int f = first + acked;
+			if (ack[0] != (acked & 0xff)) {
+				lost = true;
+				break;
+			}
+			good[f] = ((ack[1] << 8) | ack[2])
+					== crc16(0xffff, src + (f * linkparams.framesize),
+							framelen(len, f));
+			consumed += framelen(len, f);
+			acked++;
+			acklen = 0;
+		} else if (sent < frames) {
+			int f = first + sent;
+			write(uartfd, src + (f * linkparams.framesize), framelen(len, f));
+			sent++;
+		} else if (ackbytes >= (frames * FRAMEACKLEN) - 1) {
+			// the rest of the acks got lost, those frames get sent again
+			break;
+		} else if (fillers < FRAMEMAXFILLERS) {
+			write(uartfd, "\n", 1);
+			fillers++;
+		} else {
+			lost = true;
+			break;
+		}
+	}
+	if (lost)
+		return finishframes(uartfd, (end - start) - consumed);
+	finishinstructionsinmemory(uartfd);
+	if (fillers > 0)
+		drainuart(uartfd, linkparams.timeout);
+	return true;
+}
+
+static void transferframed(int uartfd, uint32_t address, int len,
+		uint8_t* buffer, bool write) {
+	assert(len <= MAXBLOCKSIZE);
+	int frames = (len + linkparams.framesize - 1) / linkparams.framesize;
+	bool good[frames];
+	memset(good, 0, sizeof(good));
+
+	for (int pass = 0; pass <= FRAMERETRIES; pass++) {
+		bool done = true;
+		for (int f = 0; f < frames; f++) {
+			if (good[f])
+				continue;
+			/*
+			 * A lost byte costs everything after it in the same run so the
+			 * retries go one frame at a time to keep them independent.
+			 */
+			int last = f;
+			while (pass == 0 && last + 1 < frames && !good[last + 1])
+				last++;
+			if (pass > 0)
+				printf("retransmitting 0x%"PRIx32" - 0x%"PRIx32"\n",
+						address + (f * linkparams.framesize),
+						address + (last * linkparams.framesize)
+								+ framelen(len, last));
+			if (write) {
+				if (!writeframes(uartfd, address, len, buffer, f, last,
+						good)) {
+					printf("framed write to 0x%"PRIx32" failed\n", address);
+					return;
+				}
+			} else
+				readframes(uartfd, address, len, buffer, f, last, good);
+			f = last;
+			done = false;
+		}
+		if (done)
+			return;
+	}
+
+	for (int f = 0; f < frames; f++) {
+		if (!good[f])
+			printf("frame at 0x%"PRIx32" failed after %d retries\n",
+					address + (f * linkparams.framesize), FRAMERETRIES);
+	}
+}
+
+/*
+ * Dual uart transfers stripe blocks across both uarts, uart 1 carries the
+ * even DUALSTRIPE byte stripes and uart 2 the odd ones. Each link delivers
+ * its stripes in order so the host only has to work out where the nth byte
+ * on each uart goes.
+ */
+#define DUALSTRIPE 0x40
+
+static bool dualtransfers = false;
+
+static int dualoffset(int uart, int pos) {
+	return ((((pos / DUALSTRIPE) * 2) + uart) * DUALSTRIPE) + (pos % DUALSTRIPE);
+}
+
+static void dualsplit(int len, int* lens) {
+	lens[0] = lens[1] = 0;
+	for (int offset = 0; offset < len; offset += DUALSTRIPE) {
+		int stripe = len - offset;
+		if (stripe > DUALSTRIPE)
+			stripe = DUALSTRIPE;
+		lens[(offset / DUALSTRIPE) % 2] += stripe;
+	}
+}
+
+// both dual stubs take their parameters in the same place
+_Static_assert(SENDBYTESDUAL_START == READBYTESDUAL_START
+		&& SENDBYTESDUAL_END == READBYTESDUAL_END
+		&& SENDBYTESDUAL_STRIPE == READBYTESDUAL_STRIPE,
+		"dual stub parameters moved");
+
+static void patchdualstub(uint8_t* stub, int len, uint32_t address, int stubsize) {
+	putlong(&stub[SENDBYTESDUAL_START], address);
+	putlong(&stub[SENDBYTESDUAL_END], address + len);
+	putword(&stub[SENDBYTESDUAL_STRIPE], DUALSTRIPE);
+	if (!loadstub(uartfd, stub, stubsize))
+		patchstub(uartfd, stub, SENDBYTESDUAL_START, SENDBYTESDUAL_STRIPE + 2);
+}
+
+// poll() keeps saying a uart that has gone away is ready
+static bool dualhungup(struct pollfd* pollfds) {
+	for (int u = 0; u < 2; u++) {
+		if (pollfds[u].revents & (POLLHUP | POLLERR | POLLNVAL)) {
+			giveup("uart has gone away");
+			return true;
+		}
+	}
+	return false;
+}
+
+static void readmemoryblock_dual(int uartfd, uint32_t address, int len,
+		uint8_t* dest) {
+	patchdualstub(_binary_stub_sendbytesdual_start, len, address,
+			sizeof(_binary_stub_sendbytesdual_start));
+	startinstructionsinmemory(uartfd, STUBAREA);
+
+	int fds[] = { uartfd, uartfd2 };
+	int lens[2], got[2] = { 0, 0 };
+	dualsplit(len, lens);
+	struct pollfd pollfds[2];
+	for (int u = 0; u < 2; u++) {
+		pollfds[u].fd = fds[u];
+		pollfds[u].events = POLLIN;
+	}
+	while (got[0] < lens[0] || got[1] < lens[1]) {
+		if (poll(pollfds, 2, linkparams.timeout * 10) <= 0) {
+			printf("dual read stalled at %d/%d and %d/%d bytes\n", got[0],
+					lens[0], got[1], lens[1]);
+			break;
+		}
+		if (dualhungup(pollfds))
+			break;
+		for (int u = 0; u < 2; u++) {
+			if (!(pollfds[u].revents & POLLIN) || got[u] == lens[u])
+				continue;
+			uint8_t buff[DUALSTRIPE];
+			int want = DUALSTRIPE - (got[u] % DUALSTRIPE);
+			if (want > lens[u] - got[u])
+				want = lens[u] - got[u];
+			int r = read(fds[u], buff, want);
+			if (r > 0) {
+				memcpy(dest + dualoffset(u, got[u]), buff, r);
+				got[u] += r;
+			}
+		}
+	}
+	finishinstructionsinmemory(uartfd);
+}
+
+static void writememoryblock_dual(int uartfd, uint32_t address, int len,
+		uint8_t* src) {
+	patchdualstub(_binary_stub_readbytesdual_start, len, address,
+			sizeof(_binary_stub_readbytesdual_start));
+	startinstructionsinmemory(uartfd, STUBAREA);
+
+	int fds[] = { uartfd, uartfd2 };
+	int lens[2], sent[2] = { 0, 0 };
+	dualsplit(len, lens);
+	struct pollfd pollfds[2];
+	for (int u = 0; u < 2; u++) {
+		pollfds[u].fd = fds[u];
+		pollfds[u].events = POLLOUT;
+	}
+	// a stripe at a time to each uart so neither waits for the other
+	while (sent[0] < lens[0] || sent[1] < lens[1]) {
+		if (poll(pollfds, 2, linkparams.timeout * 10) <= 0) {
+			printf("dual write stalled at %d/%d and %d/%d bytes\n", sent[0],
+					lens[0], sent[1], lens[1]);
+			break;
+		}
+		if (dualhungup(pollfds))
+			break;
+		for (int u = 0; u < 2; u++) {
+			if (!(pollfds[u].revents & POLLOUT) || sent[u] == lens[u])
+				continue;
+			int count = DUALSTRIPE - (sent[u] % DUALSTRIPE);
+			if (count > lens[u] - sent[u])
+				count = lens[u] - sent[u];
+			int w = write(fds[u], src + dualoffset(u, sent[u]), count);
+			if (w > 0)
+				sent[u] += w;
+		}
+	}
+	finishinstructionsinmemory(uartfd);
+}
+
 static void readmemoryblock(int uartfd, uint32_t address, int len,
 		uint8_t* dest) {
-	assert(len <= 0x7fff);
+	if (framedtransfers) {
+		transferframed(uartfd, address, len, dest, false);
+		return;
+	}
+
+	if (dualtransfers && uartfd2 >= 0) {
+		readmemoryblock_dual(uartfd, address, len, dest);
+		return;
+	}
+
+	if (rlereadback) {
+		if (readmemoryblock_rle(uartfd, address, len, dest))
+			return;
+		printf("bad run length reading 0x%"PRIx32", reading it again without rle\n",
+				address);
+	}
+
+	assert(len <= MAXBLOCKSIZE);
 	writeuart[2] = (len >> 8) & 0x7f;
 	writeuart[3] = len & 0xff;
 	writeuart[6] = (address >> 24) & 0xff;
@@ -317,26 +1045,26 @@ static void readmemoryblock(int uartfd, uint32_t address, int len,
 	writeuart[8] = (address >> 8) & 0xff;
 	writeuart[9] = address & 0xff;
 	loadinstructionbuffer(uartfd, writeuart, sizeof(writeuart));
-	runinstructionbuffer(uartfd, len, dest, -1, NULL);
+	// streamed as blocks can be much bigger than the readback buffer
+	startinstructionsinmemory(uartfd, INSTRUCTIONBUFFER);
+	readuart(uartfd, dest, len);
+	finishinstructionsinmemory(uartfd);
 }
 
 static uint8_t readmemory(int uartfd, uint32_t address, int len, uint8_t* dest) {
-	int remainder = len % 0x7fff;
+	int remainder = len % linkparams.blocksize;
 	len -= remainder;
-	for (int i = 0; i < len; i += 0x7fff) {
-		readmemoryblock(uartfd, address, 0x7fff, dest);
-		address += 0x7fff;
-		dest += 0x7fff;
+	for (int i = 0; i < len && !cancelrequested; i += linkparams.blocksize) {
+		readmemoryblock(uartfd, address, linkparams.blocksize, dest);
+		address += linkparams.blocksize;
+		dest += linkparams.blocksize;
 	}
-	if (remainder > 0)
+	if (remainder > 0 && !cancelrequested)
 		readmemoryblock(uartfd, address, remainder, dest);
 	return 0;
 }
 
-static void writememoryblock(int uartfd, uint32_t address, int len,
-		uint8_t* src) {
-
-	assert(len <= 0x7fff);
+static void loadreadbytes(int uartfd, uint32_t address, int len) {
 	uint32_t end = address + len;
 
 	_binary_instrbuffer_readbytes_start[2] = (address >> 24) & 0xff;
@@ -351,22 +1079,75 @@ static void writememoryblock(int uartfd, uint32_t address, int len,
 
 	loadinstructionbuffer(uartfd, _binary_instrbuffer_readbytes_start,
 			sizeof(_binary_instrbuffer_readbytes_start));
+}
+
+static void writememoryblock(int uartfd, uint32_t address, int len,
+		uint8_t* src) {
+
+	if (framedtransfers) {
+		transferframed(uartfd, address, len, src, true);
+		return;
+	}
+
+	if (dualtransfers && uartfd2 >= 0) {
+		writememoryblock_dual(uartfd, address, len, src);
+		return;
+	}
+
+	assert(len <= MAXBLOCKSIZE);
+	loadreadbytes(uartfd, address, len);
 	runinstructionbuffer(uartfd, 0, NULL, len, src);
 }
 
 static uint8_t writememory(int uartfd, uint32_t address, int len, uint8_t* src) {
-	int remainder = len % 0x7fff;
+	int remainder = len % linkparams.blocksize;
 	len -= remainder;
-	for (int i = 0; i < len; i += 0x7fff) {
-		writememoryblock(uartfd, address, 0x7fff, src);
-		address += 0x7fff;
-		src += 0x7fff;
+	for (int i = 0; i < len && !cancelrequested; i += linkparams.blocksize) {
+		writememoryblock(uartfd, address, linkparams.blocksize, src);
+		address += linkparams.blocksize;
+		src += linkparams.blocksize;
 	}
-	if (remainder > 0)
+	if (remainder > 0 && !cancelrequested)
 		writememoryblock(uartfd, address, remainder, src);
 	return 0;
 }
 
+/*
+ * CRC-16 of each blocksize block from address on the board, the last block
+ * can be short. The board only sends back two bytes per block so this is a
+ * lot cheaper than reading the memory back. If any of the CRCs go missing
+ * the ones that did arrive can't be matched up with their blocks so false
+ * is returned and none of them should be trusted.
+ */
+static bool readblockcrcs(int uartfd, uint32_t address, uint32_t len,
+		uint32_t blocksize, uint16_t* crcs) {
+	uint8_t* stub = _binary_stub_crcblocks_start;
+	putlong(&stub[CRCBLOCKS_LEN], len);
+	putlong(&stub[CRCBLOCKS_ADDRESS], address);
+	putlong(&stub[CRCBLOCKS_BLOCKSIZE], blocksize);
+	if (!loadstub(uartfd, stub, sizeof(_binary_stub_crcblocks_start))) {
+		patchstub(uartfd, stub, CRCBLOCKS_LEN, CRCBLOCKS_ADDRESS + 4);
+		patchstub(uartfd, stub, CRCBLOCKS_BLOCKSIZE, CRCBLOCKS_BLOCKSIZE + 4);
+	}
+
+	startinstructionsinmemory(uartfd, STUBAREA);
+	int blocks = (len + blocksize - 1) / blocksize;
+	bool complete = true;
+	for (int i = 0; i < blocks; i++) {
+		uint8_t crc[2];
+		if (readuarttimeout(uartfd, crc, 2, uartstalltimeout()) != 2) {
+			complete = false;
+			break;
+		}
+		crcs[i] = (crc[0] << 8) | crc[1];
+	}
+	// get rid of anything still on its way so the last echo lines up
+	if (!complete)
+		drainuart(uartfd, linkparams.timeout);
+	finishinstructionsinmemory(uartfd);
+	return complete;
+}
+
 static void uartsetup(int uartfd, tcflag_t baud) {
 	struct termios tio;
 	memset(&tio, 0, sizeof(tio));
@@ -396,6 +1177,33 @@ static void speedup(int uartfd) {
 		read(uartfd, &c, 1);
 }
 
+#ifndef USTCNT1
+#define USTCNT1 0xfffff900
+#endif
+#ifndef USTCNT2
+#define USTCNT2 0xfffff910
+#define UBAUD2 0xfffff912
+#endif
+
+/*
+ * Match uart 2 to whatever uart 1 ended up running at, runinit() has
+ * already given uart 2 its pins.
+ */
+static void dualsetup(int uartfd) {
+	uint8_t uart1[4];
+	char buff[64];
+	int len;
+	readmemory(uartfd, USTCNT1, sizeof(uart1), uart1);
+	len = createbrecord_word(buff, UBAUD2, getword(&uart1[2]));
+	writeandreadback(uartfd, buff, len);
+	len = createbrecord_word(buff, USTCNT2, getword(&uart1[0]));
+	writeandreadback(uartfd, buff, len);
+	uartsetup(uartfd2, B115200);
+	tcflush(uartfd2, TCIOFLUSH);
+	printf("uart 2 set up, USTCNT 0x%04x UBAUD 0x%04x\n", getword(&uart1[0]),
+			getword(&uart1[2]));
+}
+
 static void runinit(int uartfd) {
 	char buff[64];
 
@@ -520,38 +1328,308 @@ static void ledsoff(int uartfd) {
 
 }
 
-static void printhelp() {
-	printf("md\t- memory dump:\t<start address> <len> [file]\n"
-			"mm\t- memory modify:\t<start address> <value> <size> <count>\n"
-			"ub\t- upload binary:\t<start address> <file>\n"
-			"ue\t- upload elf\n"
-			"fw\t- flash write:\t<src start> <dst start> <len>\n"
-			"d\t- disassemble:\t<start address> <len>\n"
-			"r\t- run, start executing from address, read input:\t <address>\n"
-			"g\t- go, start executing from address and exit:\t<address>\n"
-			"e\t- exit\n"
-			"?\t- help\n");
+// free memory under the stubs, gs puts the initial stack here
+#define SCRATCHAREA (STUBAREA - 0x10000)
+
+// what the saved link parameters are filed under
+static char adapterkey[256];
 
+static bool readsysfsattr(const char* dir, const char* attr, char* buff,
+		int len) {
+	char path[PATH_MAX];
+	snprintf(path, sizeof(path), "%s/%s", dir, attr);
+	FILE* f = fopen(path, "r");
+	if (f == NULL)
+		return false;
+	bool ret = fgets(buff, len, f) != NULL;
+	fclose(f);
+	if (ret) {
+		// one value per attribute, drop the newline
+		buff[strcspn(buff, " \t\n")] = '\0';
+		ret = buff[0] != '\0';
+	}
+	return ret;
 }
 
-static void cmd_memorymodify(char* command) {
-	uint32_t address;
-	uint32_t value;
-	uint8_t width;
-	uint32_t count = 0;
-	char buff[256];
-	if (sscanf(command + 2, " 0x%"SCNx32" 0x%"SCNx32" %"SCNu8" %"SCNu32,
-			&address, &value, &width, &count) == 4) {
-		printf("writing 0x%"PRIx32" %"PRIu32" times starting at 0x%"PRIx32"\n",
-				value, count, address);
-		if (width == 1 || width == 2 || width == 4) {
-			int len;
-			for (int i = 0; i < count; i++) {
-				switch (width) {
-				case 1:
-					len = createbrecord_byte(buff, address, value & 0xff);
-					break;
-				case 2:
+/*
+ * USB-serial adapters are identified by vendor, product and serial number so
+ * the saved parameters follow the adapter rather than whatever ttyUSBx it
+ * came up as. Anything else just uses the device path.
+ */
+static void findadapterkey(const char* device) {
+	char dev[PATH_MAX];
+	if (realpath(device, dev) == NULL)
+		snprintf(dev, sizeof(dev), "%s", device);
+	// the key has to fit in LINKPARAMSFILE so a long path gets cut short
+	if (snprintf(adapterkey, sizeof(adapterkey), "%s", dev)
+			>= sizeof(adapterkey))
+		printf("using \"%s\" for the saved link parameters\n", adapterkey);
+
+	const char* name = strrchr(dev, '/') != NULL ? strrchr(dev, '/') + 1 : dev;
+	// ttyUSB devices hang off the interface, ttyACM devices are the interface
+	const char* parents[] = { "device/../..", "device/.." };
+	for (int i = 0; i < sizeof(parents) / sizeof(parents[0]); i++) {
+		char dir[PATH_MAX];
+		char vid[64], pid[64], serial[64] = "-";
+		if (snprintf(dir, sizeof(dir), "/sys/class/tty/%s/%s", name,
+				parents[i]) >= sizeof(dir))
+			continue;
+		if (readsysfsattr(dir, "idVendor", vid, sizeof(vid))
+				&& readsysfsattr(dir, "idProduct", pid, sizeof(pid))) {
+			readsysfsattr(dir, "serial", serial, sizeof(serial));
+			snprintf(adapterkey, sizeof(adapterkey), "%s:%s:%s", vid, pid,
+					serial);
+			return;
+		}
+	}
+}
+
+static FILE* openlinkparams(const char* mode) {
+	char path[PATH_MAX];
+	const char* home = getenv("HOME");
+	if (home == NULL)
+		return NULL;
+	snprintf(path, sizeof(path), "%s/%s", home, LINKPARAMSFILE);
+	return fopen(path, mode);
+}
+
+#define LINKPARAMSFORMAT "%d %d %d %d %d %d"
+
+static bool validlinkparams(struct linkparams* p) {
+	return p->timeout > 0 && p->blocksize > 0 && p->blocksize <= MAXBLOCKSIZE
+			&& p->dumpblocksize > 0 && p->dumpblocksize <= MAXBLOCKSIZE
+			&& p->brecordpayload > 0 && p->brecordpayload <= BRECORDMAXPAYLOAD
+			&& p->framesize > 0 && p->framesize <= MAXFRAMESIZE
+			&& p->framewindow > 0;
+}
+
+static void loadlinkparams() {
+	FILE* f = openlinkparams("r");
+	if (f == NULL)
+		return;
+	char line[512];
+	char key[256];
+	while (fgets(line, sizeof(line), f) != NULL) {
+		struct linkparams p;
+		// lines from older versions had more fields, those are dropped
+		int end = 0;
+		if (sscanf(line, "%255s "LINKPARAMSFORMAT"%n", key, &p.timeout,
+				&p.blocksize, &p.dumpblocksize, &p.brecordpayload,
+				&p.framesize, &p.framewindow, &end) == 7
+				&& (line[end] == '\n' || line[end] == '\0')
+				&& strcmp(key, adapterkey) == 0 && validlinkparams(&p)) {
+			linkparams = p;
+			printf("using saved link parameters for %s\n", adapterkey);
+		}
+	}
+	fclose(f);
+}
+
+static void savelinkparams() {
+	// keep the lines for other adapters
+	char lines[64][512];
+	int numlines = 0;
+	FILE* f = openlinkparams("r");
+	if (f != NULL) {
+		char key[256];
+		while (numlines < 63
+				&& fgets(lines[numlines], sizeof(lines[0]), f) != NULL) {
+			if (sscanf(lines[numlines], "%255s", key) == 1
+					&& strcmp(key, adapterkey) != 0)
+				numlines++;
+		}
+		fclose(f);
+	}
+
+	f = openlinkparams("w");
+	if (f == NULL) {
+		printf("failed to save link parameters\n");
+		return;
+	}
+	for (int i = 0; i < numlines; i++)
+		fputs(lines[i], f);
+	fprintf(f, "%s "LINKPARAMSFORMAT"\n", adapterkey, linkparams.timeout,
+			linkparams.blocksize, linkparams.dumpblocksize,
+			linkparams.brecordpayload, linkparams.framesize,
+			linkparams.framewindow);
+	fclose(f);
+	printf("saved link parameters for %s\n", adapterkey);
+}
+
+static double ratesince(double start, int bytes) {
+	return bytes / (now() - start);
+}
+
+static void cmd_autotune(char* command) {
+	char buff[DATABRECORDLEN(BRECORDMAXPAYLOAD)];
+	uint8_t pattern[0x4000];
+	uint8_t readback[sizeof(pattern)];
+	struct linkparams best = linkparams;
+	struct linkparams saved = linkparams;
+	bool framed = framedtransfers;
+	bool rle = rlereadback;
+	bool dual = dualtransfers;
+	double start;
+
+	// the sweeps write all over the scratch memory so it has to be asked for
+	uint32_t scratch;
+	if (sscanf(command + 1, " 0x%"SCNx32, &scratch) != 1) {
+		printf("bad input\n");
+		return;
+	}
+	if (!checkstubarea(scratch, sizeof(pattern)))
+		return;
+	printf("autotune overwrites 0x%"PRIx32" - 0x%"PRIx32"\n", scratch,
+			scratch + (uint32_t) sizeof(pattern));
+
+	// the sweeps measure the plain paths unless they say otherwise
+	framedtransfers = false;
+	rlereadback = false;
+	dualtransfers = false;
+
+	for (int i = 0; i < sizeof(pattern); i++)
+		pattern[i] = rand();
+
+	// latency timers etc dominate the round trip on most adapters
+	int len = createbrecord_word(buff, INSTRUCTIONBUFFER, NOP);
+	start = now();
+	for (int i = 0; i < 16; i++)
+		writeandreadback(uartfd, buff, len);
+	double rtt = (now() - start) / 16;
+	best.timeout = rtt * 1000 * 4;
+	if (best.timeout < 20)
+		best.timeout = 20;
+	else if (best.timeout > 1000)
+		best.timeout = 1000;
+	linkparams.timeout = best.timeout;
+	printf("round trip %.1fms, timeout %dms\n", rtt * 1000, best.timeout);
+
+	// everything that follows is bigger blocks vs. holding on to them longer
+	int blocksizes[] = { 256, 1024, 4096, MAXBLOCKSIZE };
+	double bestrate = 0;
+	for (int i = 0; i < sizeof(blocksizes) / sizeof(blocksizes[0]); i++) {
+		linkparams.blocksize = blocksizes[i];
+		start = now();
+		readmemory(uartfd, scratch, sizeof(readback), readback);
+		double rate = ratesince(start, sizeof(readback));
+		printf("read block %d: %.0f bytes/s\n", blocksizes[i], rate);
+		if (rate > bestrate) {
+			bestrate = rate;
+			best.blocksize = blocksizes[i];
+			best.dumpblocksize = blocksizes[i];
+		}
+	}
+	linkparams.blocksize = best.blocksize;
+
+	int payloads[] = { 32, 64, 128, BRECORDMAXPAYLOAD };
+	bestrate = 0;
+	for (int i = 0; i < sizeof(payloads) / sizeof(payloads[0]); i++) {
+		int total = 0x1000;
+		start = now();
+		for (int offset = 0; offset < total; offset += payloads[i]) {
+			int count = total - offset;
+			if (count > payloads[i])
+				count = payloads[i];
+			len = createbrecord(buff, scratch + offset, count,
+					pattern + offset);
+			writeandreadback(uartfd, buff, len);
+		}
+		double rate = ratesince(start, total);
+		printf("b-record payload %d: %.0f bytes/s\n", payloads[i], rate);
+		if (rate > bestrate) {
+			bestrate = rate;
+			best.brecordpayload = payloads[i];
+		}
+	}
+
+	// a round trip through the framed path, candidates that lose data are out
+	framedtransfers = true;
+	int framesizes[] = { 128, 256, 512, 1024 };
+	int windows[] = { 1, 2, 4 };
+	bestrate = 0;
+	for (int i = 0; i < sizeof(framesizes) / sizeof(framesizes[0]); i++) {
+		for (int j = 0; j < sizeof(windows) / sizeof(windows[0]); j++) {
+			int total = 0x2000;
+			linkparams.framesize = framesizes[i];
+			linkparams.framewindow = windows[j];
+			memset(readback, 0, total);
+			start = now();
+			writememory(uartfd, scratch, total, pattern);
+			readmemory(uartfd, scratch, total, readback);
+			double rate = ratesince(start, total * 2);
+			bool ok = memcmp(pattern, readback, total) == 0;
+			printf("frame %d, window %d: %.0f bytes/s%s\n", framesizes[i],
+					windows[j], rate, ok ? "" : " (corrupted)");
+			if (ok && rate > bestrate) {
+				bestrate = rate;
+				best.framesize = framesizes[i];
+				best.framewindow = windows[j];
+			}
+		}
+	}
+	linkparams.framesize = best.framesize;
+	linkparams.framewindow = best.framewindow;
+
+	framedtransfers = framed;
+	rlereadback = rle;
+	dualtransfers = dual;
+	if (cancelrequested) {
+		printf("cancelled, link parameters not saved\n");
+		linkparams = saved;
+		return;
+	}
+	linkparams = best;
+	savelinkparams();
+}
+
+static void printhelp() {
+	printf("md\t- memory dump:\t<start address> <len> [file]\n"
+			"mm\t- memory modify:\t<start address> <value> <size> <count>\n"
+			"cp\t- copy on the board:\t<src address> <dst address> <len>\n"
+			"cmp\t- compare on the board:\t<address> <address> <len>\n"
+			"ub\t- upload binary:\t[--resume] <start address> <file>\n"
+			"ue\t- upload elf\n"
+			"fw\t- flash write:\t<src start> <dst start> <len>\n"
+			"d\t- disassemble:\t<start address> <len>\n"
+			"r\t- run, start executing from address, read input:\t <address>\n"
+			"rp\t- run and profile:\t<address> <elf> [samples per second] [samples]\n"
+			"g\t- go, start executing from address and exit:\t<address>\n"
+			"gs\t- gdb server for code at address:\t<port> <address>\n"
+			"t\t- run the tests in a manifest:\t<manifest> [results file]\n"
+			"watch\t- sample memory until cancelled:\t<address> <len> <samples per second> [file]\n"
+			"a\t- autotune and save link parameters, overwrites 16K at:\t<scratch address>\n"
+			"s\t- set option:\t<option> <on|off>\n"
+			"\t  rle - run length encode memory reads on the board\n"
+			"\t  crc - CRC checked frames for memory reads/writes and ub\n"
+			"\t  dual - stripe memory reads/writes across both uarts, needs -D\n"
+			"jobs\t- list queued, running and finished jobs\n"
+			"cancel\t- cancel a job, the running or next one by default:\t[job]\n"
+			"wait\t- wait for a job, all of them by default:\t[job]\n"
+			"\t  end a command with & to run it in the background\n"
+			"e\t- exit once all jobs are finished\n"
+			"?\t- help\n");
+
+}
+
+static void cmd_memorymodify(char* command) {
+	uint32_t address;
+	uint32_t value;
+	uint8_t width;
+	uint32_t count = 0;
+	char buff[256];
+	if (sscanf(command + 2, " 0x%"SCNx32" 0x%"SCNx32" %"SCNu8" %"SCNu32,
+			&address, &value, &width, &count) == 4) {
+		printf("writing 0x%"PRIx32" %"PRIu32" times starting at 0x%"PRIx32"\n",
+				value, count, address);
+		if (width == 1 || width == 2 || width == 4) {
+			int len;
+			stubareawritten(address, count * width);
+			for (int i = 0; i < count; i++) {
+				switch (width) {
+				case 1:
+					len = createbrecord_byte(buff, address, value & 0xff);
+					break;
+				case 2:
 					len = createbrecord_word(buff, address, value & 0xffff);
 					break;
 				case 4:
@@ -584,39 +1662,42 @@ static bool checkblock(uint32_t addr, uint32_t* values, uint32_t* readback,
 static void cmd_memorytest(char* command) {
 
 	const uint32_t startaddr = 0x0;
-	const uint32_t end = startaddr + (32 * 1024 * 1024);
+	// the stubs that read the pattern back live above this
+	const uint32_t end = STUBAREA;
 	printf("\n");
 	uint32_t values[BRECORDMAXPAYLOAD / sizeof(uint32_t)];
 	uint32_t readback[BRECORDMAXPAYLOAD / sizeof(uint32_t)];
 	bool failed = false;
 	int value = 0;
 	char brecordbuff[DATABRECORDLEN(BRECORDMAXPAYLOAD)];
-	for (uint32_t addr = startaddr; addr < end; addr += sizeof(values)) {
+	for (uint32_t addr = startaddr; addr < end && !cancelrequested; addr +=
+			sizeof(values)) {
 		for (int i = 0; i < (sizeof(values) / sizeof(values[0])); i++) {
 			values[i] = value;
 			value++;
 		}
-		printf("\33[2K\rwrite %x", addr);
-		fflush(stdout);
+		progress("write", addr - startaddr, end - startaddr);
 		int len = createbrecord(brecordbuff, addr, sizeof(values),
 				(uint8_t*) values);
 		writeandreadback(uartfd, brecordbuff, len);
 		readmemory(uartfd, addr, sizeof(readback), (uint8_t*) readback);
-		if (!checkblock(addr, values, readback, sizeof(values)))
+		if (cancelrequested || !checkblock(addr, values, readback,
+				sizeof(values)))
 			break;
 	}
 
 //if (!failed) {
 	value = startaddr;
-	for (uint32_t addr = startaddr; addr < end; addr += sizeof(values)) {
+	for (uint32_t addr = startaddr; addr < end && !cancelrequested; addr +=
+			sizeof(values)) {
 		for (int i = 0; i < (sizeof(values) / sizeof(values[0])); i++) {
 			values[i] = value;
 			value++;
 		}
-		printf("\33[2K\rreadback %x", addr);
-		fflush(stdout);
+		progress("readback", addr - startaddr, end - startaddr);
 		readmemory(uartfd, addr, sizeof(readback), (uint8_t*) readback);
-		if (!checkblock(addr, values, readback, sizeof(values)))
+		if (cancelrequested || !checkblock(addr, values, readback,
+				sizeof(values)))
 			break;
 	}
 //}
@@ -628,7 +1709,8 @@ static void cmd_memorydump(char* command) {
 	uint32_t address = 0;
 	uint32_t len = 0;
 	char filepath[256];
-	uint8_t memblock[256];
+	uint8_t memblock[MAXBLOCKSIZE];
+	int blocksize = linkparams.dumpblocksize;
 
 	int args = sscanf(command + 2, " 0x%"SCNx32" %"SCNu32" %255[^\n]s",
 			&address, &len, filepath);
@@ -648,84 +1730,439 @@ static void cmd_memorydump(char* command) {
 			}
 		}
 
-		int partial = len % sizeof(memblock);
+		int partial = len % blocksize;
 		int loops;
 		if (partial != 0)
-			loops = (len + sizeof(memblock) - partial) / sizeof(memblock);
+			loops = (len + blocksize - partial) / blocksize;
 		else
-			loops = len / sizeof(memblock);
+			loops = len / blocksize;
 		printf("loops %d\n", loops);
-		for (int l = 0; l < loops; l++) {
-			uint32_t offset = sizeof(memblock) * l;
-			int readlen = sizeof(memblock);
+		for (int l = 0; l < loops && !cancelrequested; l++) {
+			uint32_t offset = blocksize * l;
+			int readlen = blocksize;
 			if (readlen + offset > len)
-				readlen = len % sizeof(memblock);
+				readlen = len % blocksize;
 
-			memset(memblock, 0xff, sizeof(memblock));
+			memset(memblock, 0xff, blocksize);
 
 			readmemory(uartfd, address + offset, readlen, memblock);
 			if (file != NULL)
 				fwrite(memblock, 1, readlen, file);
 			else
 				printblock(address + offset, memblock, readlen, l == 0);
+			if (file != NULL)
+				progress("read", offset + readlen, len);
 		}
+		if (file != NULL)
+			printf("\n");
+		if (cancelrequested)
+			printf("cancelled\n");
 		if (file != NULL)
 			fclose(file);
 	} else
 		printf("bad input\n");
 }
 
+/*
+ * cp and cmp work on the board with copymemory and comparememory so nothing
+ * but the parameters and the result goes over the link. The stubs don't
+ * send anything until they're done so the readback waits for them.
+ */
+static void copyregion(uint32_t src, uint32_t dst, uint32_t len) {
+	uint8_t* stub = _binary_stub_copymemory_start;
+	putlong(&stub[COPYMEMORY_SRC], src);
+	putlong(&stub[COPYMEMORY_DST], dst);
+	putlong(&stub[COPYMEMORY_LEN], len);
+	// a forwards copy into the end of src would copy what it already wrote
+	putword(&stub[COPYMEMORY_BACKWARDS], dst > src && dst - src < len);
+	if (!loadstub(uartfd, stub, sizeof(_binary_stub_copymemory_start)))
+		patchstub(uartfd, stub, COPYMEMORY_SRC, COPYMEMORY_BACKWARDS + 2);
+	runinstructionsinmemory(uartfd, STUBAREA, 0, NULL, 0, NULL);
+}
+
+static void cmd_copy(char* command) {
+	uint32_t src, dst, len;
+	if (sscanf(command + 2, " 0x%"SCNx32" 0x%"SCNx32" %"SCNu32, &src, &dst,
+			&len) != 3) {
+		printf("bad input\n");
+		return;
+	}
+	if (!checkstubarea(dst, len))
+		return;
+	printf("copying %"PRIu32" bytes from 0x%"PRIx32" to 0x%"PRIx32"\n", len,
+			src, dst);
+	double start = now();
+	copyregion(src, dst, len);
+	if (cancelrequested)
+		printf("cancelled\n");
+	else
+		printf("done in %.3fs\n", now() - start);
+}
+
+static void cmd_compare(char* command) {
+	uint32_t a, b, len;
+	if (sscanf(command + 3, " 0x%"SCNx32" 0x%"SCNx32" %"SCNu32, &a, &b, &len)
+			!= 3) {
+		printf("bad input\n");
+		return;
+	}
+	uint8_t* stub = _binary_stub_comparememory_start;
+	putlong(&stub[COMPAREMEMORY_A], a);
+	putlong(&stub[COMPAREMEMORY_B], b);
+	putlong(&stub[COMPAREMEMORY_LEN], len);
+	if (!loadstub(uartfd, stub, sizeof(_binary_stub_comparememory_start)))
+		patchstub(uartfd, stub, COMPAREMEMORY_A, COMPAREMEMORY_LEN + 4);
+	uint8_t result[5];
+	runinstructionsinmemory(uartfd, STUBAREA, sizeof(result), result, 0,
+	NULL);
+	if (result[0] == 0)
+		printf("%"PRIu32" bytes at 0x%"PRIx32" and 0x%"PRIx32" are the same\n",
+				len, a, b);
+	else {
+		uint32_t offset = getlong(&result[1]) - a;
+		printf("first difference at 0x%"PRIx32" and 0x%"PRIx32
+				", offset 0x%"PRIx32"\n", a + offset, b + offset, offset);
+	}
+}
+
 //#define USEFASTERUPLOAD
 
+/*
+ * ub keeps a sidecar file next to the image with the CRC of each block that
+ * has been uploaded and verified on the board. If the upload is interrupted
+ * ub --resume checks the recorded blocks against the board in one go and
+ * carries on from the first one that doesn't match.
+ */
+#define UBSTATEBLOCK 0x1000
+#define UBSTATESUFFIX ".ubstate"
+#define UBSTATEHEADER "ub 0x%"PRIx32" %lld %lld %d\n"
+#define UBSTATESCAN "ub 0x%"SCNx32" %lld %lld %d\n"
+#define UBRETRIES 4
+
+// returns how many block CRCs were recorded for this address and image
+static int loadubstate(const char* path, uint32_t address, struct stat* st,
+		uint16_t* crcs, int blocks) {
+	FILE* f = fopen(path, "r");
+	if (f == NULL) {
+		printf("no upload state in \"%s\"\n", path);
+		return 0;
+	}
+
+	uint32_t stateaddress;
+	long long size, mtime;
+	int blocksize;
+	int recorded = 0;
+	if (fscanf(f, UBSTATESCAN, &stateaddress, &size, &mtime, &blocksize) == 4
+			&& stateaddress == address && size == st->st_size
+			&& mtime == st->st_mtime && blocksize == UBSTATEBLOCK) {
+		unsigned int crc;
+		while (recorded < blocks && fscanf(f, "%x", &crc) == 1)
+			crcs[recorded++] = crc;
+	} else
+		printf("upload state in \"%s\" is for a different upload\n", path);
+	fclose(f);
+	return recorded;
+}
+
+static FILE* saveubstate(const char* path, uint32_t address, struct stat* st,
+		uint16_t* crcs, int verified) {
+	FILE* f = fopen(path, "w");
+	if (f == NULL) {
+		printf("failed to create \"%s\"\n", path);
+		return NULL;
+	}
+	fprintf(f, UBSTATEHEADER, address, (long long) st->st_size,
+			(long long) st->st_mtime, UBSTATEBLOCK);
+	for (int i = 0; i < verified; i++)
+		fprintf(f, "%04x\n", crcs[i]);
+	fflush(f);
+	return f;
+}
+
+static void uploadblock(uint32_t address, uint8_t* buff, int len) {
+	char brecordbuff[DATABRECORDLEN(BRECORDMAXPAYLOAD)];
+#ifdef USEFASTERUPLOAD
+	writememory(uartfd, address, len, buff);
+#else
+	// framed and dual writes are only worth it for big blocks
+	if (framedtransfers || (dualtransfers && uartfd2 >= 0))
+		writememory(uartfd, address, len, buff);
+	else {
+		for (int offset = 0; offset < len; offset +=
+				linkparams.brecordpayload) {
+			int count = len - offset;
+			if (count > linkparams.brecordpayload)
+				count = linkparams.brecordpayload;
+			int brecordlen = createbrecord(brecordbuff, address + offset,
+					count, buff + offset);
+			writeandreadback(uartfd, brecordbuff, brecordlen);
+		}
+	}
+#endif
+}
+
+// upload a block and check it made it with its CRC, retrying a few times
+static bool uploadverifiedblock(uint32_t address, uint8_t* buff, int len) {
+	uint16_t crc = crc16(0xffff, buff, len);
+	uint16_t boardcrc = ~crc;
+	for (int i = 0; i <= UBRETRIES && boardcrc != crc && !cancelrequested;
+			i++) {
+		uploadblock(address, buff, len);
+		if (!readblockcrcs(uartfd, address, len, UBSTATEBLOCK, &boardcrc))
+			boardcrc = ~crc;
+	}
+	return boardcrc == crc;
+}
+
 static void cmd_uploadbinary(char* command) {
 	uint32_t address = 0;
-	char brecordbuff[DATABRECORDLEN(BRECORDMAXPAYLOAD)];
 	char file[256];
-	if (sscanf(command + 2, " 0x%"SCNx32" %255[^\n]s", &address, file) == 2) {
+	char* args = command + 2;
+	bool resume = false;
+	if (strncmp(args, " --resume", 9) == 0) {
+		resume = true;
+		args += 9;
+	}
+	if (sscanf(args, " 0x%"SCNx32" %255[^\n]s", &address, file) == 2) {
 		printf("loading \"%s\" to 0x%"PRIx32"\n", file, address);
 		FILE* f = fopen(file, "r");
-		int written = 0;
-		if (f != NULL) {
-			uint8_t buff[BRECORDMAXPAYLOAD];
-			size_t read;
-			printf("\n");
-			while ((read = fread(buff, 1, sizeof(buff), f)) != 0) {
-				if (read > 0) {
-#ifdef USEFASTERUPLOAD
-					writememory(uartfd, address + written, read, buff);
-#else
-					int len = createbrecord(brecordbuff, address + written,
-							read, buff);
-					writeandreadback(uartfd, brecordbuff, len);
-#endif
-					written += read;
-					printf("\33[2K\r%d bytes", written);
-					fflush(stdout);
-					//break;
-				}
-			}
-			printf("\n");
+		if (f == NULL) {
+			printf("failed to open \"%s\"\n", file);
+			return;
+		}
+
+		struct stat st;
+		if (fstat(fileno(f), &st) != 0) {
+			printf("failed to stat \"%s\"\n", file);
 			fclose(f);
-			printf("wrote %d bytes\n", written);
+			return;
+		}
+		if (!checkstubarea(address, st.st_size)) {
+			fclose(f);
+			return;
+		}
+		int blocks = (st.st_size + UBSTATEBLOCK - 1) / UBSTATEBLOCK;
+		uint16_t* crcs = malloc((blocks + 1) * sizeof(uint16_t));
+		char statepath[PATH_MAX];
+		snprintf(statepath, sizeof(statepath), "%s"UBSTATESUFFIX, file);
+
+		int verified = 0;
+		if (resume) {
+			int recorded = loadubstate(statepath, address, &st, crcs, blocks);
+			if (recorded > 0) {
+				uint16_t boardcrcs[recorded];
+				uint32_t len = recorded * UBSTATEBLOCK;
+				if (len > st.st_size)
+					len = st.st_size;
+				if (readblockcrcs(uartfd, address, len, UBSTATEBLOCK,
+						boardcrcs)) {
+					while (verified < recorded
+							&& boardcrcs[verified] == crcs[verified])
+						verified++;
+				} else
+					printf("couldn't read the CRCs back, starting again\n");
+			}
+			printf("resuming at 0x%"PRIx32", %d of %d blocks already on the "
+					"board\n", address + (verified * UBSTATEBLOCK), verified,
+					blocks);
+		}
+
+		FILE* state = saveubstate(statepath, address, &st, crcs, verified);
+		uint8_t buff[UBSTATEBLOCK];
+		int written = verified * UBSTATEBLOCK;
+		size_t read;
+		fseek(f, written, SEEK_SET);
+		printf("\n");
+		while (!cancelrequested && (read = fread(buff, 1, sizeof(buff), f)) != 0) {
+			uint16_t crc = crc16(0xffff, buff, read);
+			if (!uploadverifiedblock(address + written, buff, read)) {
+				printf("\nblock at 0x%"PRIx32" failed to verify after %d "
+						"retries, use ub --resume to carry on\n",
+						address + written, UBRETRIES);
+				break;
+			}
+			if (state != NULL) {
+				fprintf(state, "%04x\n", crc);
+				fflush(state);
+			}
+			written += read;
+			progress("upload", written, st.st_size);
+		}
+		printf("\n");
+		if (cancelrequested)
+			printf("cancelled, use ub --resume to carry on\n");
+		fclose(f);
+		if (state != NULL) {
+			fclose(state);
+			// nothing left to resume
+			if (written == st.st_size)
+				remove(statepath);
+		}
+		free(crcs);
+		printf("wrote %d bytes\n", written);
+	}
+}
+
+/*
+ * Just enough of a big endian ELF32 file for the profiler, the symbols to
+ * turn sampled PCs into function names and the loaded sections so the
+ * disassembler doesn't have to go to the board while the code is running.
+ */
+struct elfsymbol {
+	uint32_t address;
+	uint32_t size;
+	const char* name;
+};
+
+struct elf {
+	uint8_t* data;
+	size_t len;
+	struct elfsymbol* symbols;
+	int numsymbols;
+};
+
+static bool elfsection(struct elf* elf, int index, Elf32_Shdr* section) {
+	uint32_t shoff = getlong(elf->data + offsetof(Elf32_Ehdr, e_shoff));
+	uint16_t shentsize = getword(
+			elf->data + offsetof(Elf32_Ehdr, e_shentsize));
+	uint16_t shnum = getword(elf->data + offsetof(Elf32_Ehdr, e_shnum));
+	uint8_t* sh = elf->data + shoff + (index * shentsize);
+	if (index >= shnum || shentsize < sizeof(Elf32_Shdr)
+			|| shoff + ((index + 1) * shentsize) > elf->len)
+		return false;
+	section->sh_type = getlong(sh + offsetof(Elf32_Shdr, sh_type));
+	section->sh_flags = getlong(sh + offsetof(Elf32_Shdr, sh_flags));
+	section->sh_addr = getlong(sh + offsetof(Elf32_Shdr, sh_addr));
+	section->sh_offset = getlong(sh + offsetof(Elf32_Shdr, sh_offset));
+	section->sh_size = getlong(sh + offsetof(Elf32_Shdr, sh_size));
+	section->sh_link = getlong(sh + offsetof(Elf32_Shdr, sh_link));
+	return section->sh_type == SHT_NOBITS
+			|| section->sh_offset + section->sh_size <= elf->len;
+}
+
+static int comparesymbols(const void* a, const void* b) {
+	const struct elfsymbol* sa = a;
+	const struct elfsymbol* sb = b;
+	return (sa->address > sb->address) - (sa->address < sb->address);
+}
+
+static void loadelfsymbols(struct elf* elf) {
+	Elf32_Shdr symtab, strtab;
+	for (int i = 0; elfsection(elf, i, &symtab); i++) {
+		if (symtab.sh_type != SHT_SYMTAB
+				|| !elfsection(elf, symtab.sh_link, &strtab))
+			continue;
+		int count = symtab.sh_size / sizeof(Elf32_Sym);
+		elf->symbols = realloc(elf->symbols,
+				(elf->numsymbols + count) * sizeof(struct elfsymbol));
+		for (int s = 0; s < count; s++) {
+			uint8_t* sym = elf->data + symtab.sh_offset
+					+ (s * sizeof(Elf32_Sym));
+			uint32_t name = getlong(sym + offsetof(Elf32_Sym, st_name));
+			uint8_t type = ELF32_ST_TYPE(sym[offsetof(Elf32_Sym, st_info)]);
+			uint16_t shndx = getword(sym + offsetof(Elf32_Sym, st_shndx));
+			if ((type != STT_FUNC && type != STT_NOTYPE) || shndx == SHN_UNDEF
+					|| shndx >= SHN_LORESERVE || name == 0
+					|| name >= strtab.sh_size)
+				continue;
+			struct elfsymbol* symbol = &elf->symbols[elf->numsymbols++];
+			symbol->address = getlong(sym + offsetof(Elf32_Sym, st_value));
+			symbol->size = getlong(sym + offsetof(Elf32_Sym, st_size));
+			symbol->name = (char*) elf->data + strtab.sh_offset + name;
+		}
+	}
+	qsort(elf->symbols, elf->numsymbols, sizeof(struct elfsymbol),
+			comparesymbols);
+}
+
+static bool loadelf(const char* path, struct elf* elf) {
+	memset(elf, 0, sizeof(*elf));
+	FILE* f = fopen(path, "r");
+	if (f == NULL) {
+		printf("failed to open \"%s\"\n", path);
+		return false;
+	}
+	fseek(f, 0, SEEK_END);
+	elf->len = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	elf->data = malloc(elf->len + 1);
+	elf->len = fread(elf->data, 1, elf->len, f);
+	// so the last string in the file is always terminated
+	elf->data[elf->len] = '\0';
+	fclose(f);
+
+	if (elf->len < sizeof(Elf32_Ehdr) || memcmp(elf->data, ELFMAG, SELFMAG) != 0
+			|| elf->data[EI_CLASS] != ELFCLASS32
+			|| elf->data[EI_DATA] != ELFDATA2MSB) {
+		printf("\"%s\" isn't a big endian ELF32 file\n", path);
+		free(elf->data);
+		return false;
+	}
+	loadelfsymbols(elf);
+	return true;
+}
+
+static void freeelf(struct elf* elf) {
+	free(elf->symbols);
+	free(elf->data);
+}
+
+// the symbol address is in or NULL
+static struct elfsymbol* elfsymbol(struct elf* elf, uint32_t address) {
+	int lo = 0, hi = elf->numsymbols - 1;
+	struct elfsymbol* found = NULL;
+	while (lo <= hi) {
+		int mid = (lo + hi) / 2;
+		if (elf->symbols[mid].address <= address) {
+			found = &elf->symbols[mid];
+			lo = mid + 1;
 		} else
-			printf("failed to open \"%s\"\n", file);
+			hi = mid - 1;
+	}
+	if (found != NULL && found->size != 0
+			&& address >= found->address + found->size)
+		return NULL;
+	return found;
+}
+
+static bool elfread(struct elf* elf, uint32_t address, uint8_t* dest, int len) {
+	Elf32_Shdr section;
+	for (int i = 0; elfsection(elf, i, &section); i++) {
+		if (!(section.sh_flags & SHF_ALLOC) || section.sh_type == SHT_NOBITS)
+			continue;
+		if (address >= section.sh_addr
+				&& address + len <= section.sh_addr + section.sh_size) {
+			memcpy(dest, elf->data + section.sh_offset
+					+ (address - section.sh_addr), len);
+			return true;
+		}
 	}
+	return false;
+}
+
+// when set the disassembler reads from here instead of the board
+static struct elf* disassemblyimage = NULL;
+
+static void readdisassembler(uint32_t address, uint8_t* dest, int len) {
+	if (disassemblyimage == NULL
+			|| !elfread(disassemblyimage, address, dest, len))
+		readmemory(uartfd, address, len, dest);
 }
 
 unsigned int m68k_read_disassembler_8(unsigned int address) {
 	uint8_t byte;
-	readmemory(uartfd, address, 1, &byte);
+	readdisassembler(address, &byte, 1);
 	return byte;
 }
 unsigned int m68k_read_disassembler_16(unsigned int address) {
 	uint8_t word[2];
-	readmemory(uartfd, address, 2, word);
-	return (word[0] << 8) | word[1];
+	readdisassembler(address, word, 2);
+	return getword(word);
 }
 unsigned int m68k_read_disassembler_32(unsigned int address) {
 	uint8_t lon[4];
-	readmemory(uartfd, address, 4, lon);
-	return (lon[0] << 24) | (lon[1] << 16) | (lon[3] << 8) | lon[4];
+	readdisassembler(address, lon, 4);
+	return getlong(lon);
 }
 
 static void cmd_disassemble(char* command) {
@@ -743,6 +2180,108 @@ static void cmd_disassemble(char* command) {
 	}
 }
 
+// runtest.S at RUNTEST calls code so it can be stopped, used by t and rp
+#define TESTRETURNMARKER 0xfc
+#define TESTABORTMARKER 0xfb
+#define TESTABORTTIMEOUT 1
+#define TESTPOLL 20
+
+// sampled PCs collected by rp, max is 0 to keep going until cancelled
+struct samples {
+	uint32_t* pcs;
+	int count;
+	int capacity;
+	int max;
+	// bytes left of the record being received
+	int pcbytes;
+	uint32_t pc;
+	int exitbytes;
+	bool returned;
+	// runtest only sends TESTABORTMARKER once it has been sent a byte
+	bool abortsent;
+	bool aborted;
+	uint32_t exitcode;
+};
+
+#define PROFILERMARKER 0xfe
+
+static void addsample(struct samples* samples, uint32_t pc) {
+	if (samples->max != 0 && samples->count == samples->max)
+		return;
+	if (samples->count == samples->capacity) {
+		samples->capacity = samples->capacity ? samples->capacity * 2 : 1024;
+		samples->pcs = realloc(samples->pcs,
+				samples->capacity * sizeof(uint32_t));
+	}
+	samples->pcs[samples->count++] = pc;
+}
+
+/*
+ * Pick the profiler's samples and runtest's return or abort out of the
+ * output from the board. Returns true if c is console output.
+ */
+static bool profilerbyte(struct samples* samples, uint8_t c) {
+	if (samples->pcbytes > 0) {
+		samples->pc = (samples->pc << 8) | c;
+		if (--samples->pcbytes == 0)
+			addsample(samples, samples->pc);
+	} else if (samples->exitbytes > 0) {
+		samples->exitcode = (samples->exitcode << 8) | c;
+		if (--samples->exitbytes == 0)
+			samples->returned = true;
+	} else if (c == PROFILERMARKER) {
+		samples->pcbytes = 4;
+		samples->pc = 0;
+	} else if (c == TESTRETURNMARKER)
+		samples->exitbytes = 4;
+	else if (c == TESTABORTMARKER && samples->abortsent)
+		samples->aborted = true;
+	else
+		return true;
+	return false;
+}
+
+/*
+ * Pass the terminal through to the board and print what comes back until
+ * cancelled. With samples the code is running under runtest, which any
+ * byte sent to the board would stop, so nothing is passed through and
+ * the profiler's records are picked out of the output until the code
+ * returns. A console byte of PROFILERMARKER or TESTRETURNMARKER will be
+ * taken for one of those records.
+ */
+static void relayconsole(struct samples* samples) {
+	struct termios tty, otty;
+	tcgetattr(0, &otty);
+	tty = otty;
+	tty.c_lflag = tty.c_lflag & ~(ECHO | ECHOK | ICANON);
+	tty.c_cc[VTIME] = 1;
+	tcsetattr(0, TCSANOW, &tty);
+	char c;
+	struct pollfd fds[2];
+	fds[0].fd = 0;
+	fds[0].events = POLLIN;
+	fds[1].fd = uartfd;
+	fds[1].events = POLLIN;
+	int nfds = samples == NULL ? 2 : 1;
+	if (samples != NULL)
+		fds[0].fd = uartfd;
+	while (!cancelrequested
+			&& (samples == NULL
+					|| ((samples->max == 0 || samples->count < samples->max)
+							&& !samples->returned))) {
+		if (poll(fds, nfds, 0)) {
+			if (samples == NULL && (fds[0].revents & POLLIN)
+					&& fread(&c, 1, 1, stdin) == 1)
+				write(uartfd, &c, 1);
+			if ((fds[nfds - 1].revents & POLLIN) && read(uartfd, &c, 1) == 1) {
+				if (samples == NULL || profilerbyte(samples, c))
+					printf("%c", c);
+			}
+		}
+	}
+	tcsetattr(0, TCSANOW, &otty);
+}
+
 static void cmd_go(char* command, bool readinput) {
 	uint32_t address = 0;
 	if (sscanf(command + 2, " 0x%"SCNx32, &address) == 1) {
@@ -755,35 +2294,1108 @@ static void cmd_go(char* command, bool readinput) {
 
 		if (readinput) {
 			printf("Reading input from board\n");
-			struct termios tty, otty;
-			tcgetattr(0, &otty);
-			tty = otty;
-			tty.c_lflag = tty.c_lflag & ~(ECHO | ECHOK | ICANON);
-			tty.c_cc[VTIME] = 1;
-			tcsetattr(0, TCSANOW, &tty);
-			char c;
-			struct pollfd fds[2];
-			fds[0].fd = 0;
-			fds[0].events = POLLIN;
-			fds[1].fd = uartfd;
-			fds[1].events = POLLIN;
-			while (true) {
-				if (poll(fds, 2, 0)) {
-					if ((fds[0].revents & POLLIN)
-							&& fread(&c, 1, 1, stdin) == 1)
-						write(uartfd, &c, 1);
-					if ((fds[1].revents & POLLIN) && read(uartfd, &c, 1) == 1)
-						printf("%c", c);
+			relayconsole(NULL);
+		}
+	}
+}
+
+/*
+ * rp profiles code by sampling the PC from a timer 1 interrupt. runinit()
+ * points the interrupt controller at vectors 0x40 - 0x47 so timer 1 (level
+ * 6) ends up at 0x46. The handler streams 0xfe and the PC for each sample
+ * between whatever the code prints on the console. The code is called by
+ * runtest so once there are enough samples, or rp is cancelled, it can be
+ * stopped and the timer turned off with the bootloader back in control.
+ */
+#define TMR1VECTOR (0x46 * 4)
+#define IMR_MTMR1 (1 << 1)
+#ifndef TCTL1
+#define TCTL1 0xfffff600
+#define TPRER1 0xfffff602
+#define TCMP1 0xfffff604
+#define TSTAT1 0xfffff60a
+#endif
+#define PROFILERCLOCK 32768
+#define PROFILERMAXRATE 2000
+#define PROFILERHOTSPOTS 10
+#define PROFILERFUNCTIONS 20
+
+struct profileentry {
+	uint32_t address;
+	int count;
+};
+
+static int compareprofileentries(const void* a, const void* b) {
+	const struct profileentry* ea = a;
+	const struct profileentry* eb = b;
+	return eb->count - ea->count;
+}
+
+static int comparepcs(const void* a, const void* b) {
+	uint32_t pa = *(const uint32_t*) a;
+	uint32_t pb = *(const uint32_t*) b;
+	return (pa > pb) - (pa < pb);
+}
+
+static void printprofile(struct elf* elf, struct samples* samples) {
+	if (samples->count == 0) {
+		printf("no samples\n");
+		return;
+	}
+	qsort(samples->pcs, samples->count, sizeof(uint32_t), comparepcs);
+
+	// flat profile by function, entries are symbol indexes
+	struct profileentry functions[elf->numsymbols + 1];
+	for (int i = 0; i <= elf->numsymbols; i++) {
+		functions[i].address = i;
+		functions[i].count = 0;
+	}
+	// the samples are sorted so each distinct PC is one run
+	int numhotspots = 0;
+	struct profileentry* hotspots = malloc(
+			samples->count * sizeof(struct profileentry));
+	for (int i = 0; i < samples->count; i++) {
+		uint32_t pc = samples->pcs[i];
+		struct elfsymbol* symbol = elfsymbol(elf, pc);
+		functions[symbol != NULL ? symbol - elf->symbols : elf->numsymbols].count++;
+		if (numhotspots == 0 || hotspots[numhotspots - 1].address != pc) {
+			hotspots[numhotspots].address = pc;
+			hotspots[numhotspots++].count = 0;
+		}
+		hotspots[numhotspots - 1].count++;
+	}
+
+	printf("%d samples\n\n  %%time\tsamples\tfunction\n", samples->count);
+	qsort(functions, elf->numsymbols + 1, sizeof(struct profileentry),
+			compareprofileentries);
+	for (int i = 0;
+			i < elf->numsymbols + 1 && i < PROFILERFUNCTIONS
+					&& functions[i].count > 0; i++) {
+		printf("%6.2f%%\t%d\t%s\n",
+				(functions[i].count * 100.0) / samples->count,
+				functions[i].count,
+				functions[i].address == elf->numsymbols ?
+						"[unknown]" : elf->symbols[functions[i].address].name);
+	}
+
+	printf("\n  %%time\tsamples\taddress\n");
+	qsort(hotspots, numhotspots, sizeof(struct profileentry),
+			compareprofileentries);
+	disassemblyimage = elf;
+	for (int i = 0; i < numhotspots && i < PROFILERHOTSPOTS; i++) {
+		char disbuff[256];
+		uint32_t pc = hotspots[i].address;
+		struct elfsymbol* symbol = elfsymbol(elf, pc);
+		uint8_t probe;
+		// nothing to disassemble if the PC isn't in the image
+		if (elfread(elf, pc, &probe, 1))
+			m68k_disassemble(disbuff, pc, M68K_CPU_TYPE_68000);
+		else
+			strcpy(disbuff, "?");
+		printf("%6.2f%%\t%d\t0x%08"PRIx32" <%s+0x%"PRIx32">\t%s\n",
+				(hotspots[i].count * 100.0) / samples->count,
+				hotspots[i].count, pc,
+				symbol != NULL ? symbol->name : "?",
+				symbol != NULL ? pc - symbol->address : pc, disbuff);
+	}
+	disassemblyimage = NULL;
+	free(hotspots);
+}
+
+static void cmd_profile(char* command) {
+	uint32_t address = 0;
+	char file[256];
+	int rate = 500;
+	struct samples samples = { 0 };
+	int args = sscanf(command + 2, " 0x%"SCNx32" %255s %d %d", &address, file,
+			&rate, &samples.max);
+	if (args < 2 || rate <= 0 || rate > PROFILERMAXRATE) {
+		printf("bad input\n");
+		return;
+	}
+
+	struct elf elf;
+	if (!loadelf(file, &elf))
+		return;
+	printf("%d symbols from \"%s\"\n", elf.numsymbols, file);
+
+	char buff[64];
+	int len;
+	loadinstructionsintomemory(uartfd, PROFILERHANDLER,
+			_binary_stub_profiler_start, sizeof(_binary_stub_profiler_start));
+	len = createbrecord_double(buff, TMR1VECTOR, PROFILERHANDLER);
+	writeandreadback(uartfd, buff, len);
+	len = createbrecord_word(buff, TCTL1, 0);
+	writeandreadback(uartfd, buff, len);
+	len = createbrecord_word(buff, TPRER1, 0);
+	writeandreadback(uartfd, buff, len);
+	len = createbrecord_word(buff, TCMP1, PROFILERCLOCK / rate);
+	writeandreadback(uartfd, buff, len);
+	len = createbrecord_word(buff, TSTAT1, 0);
+	writeandreadback(uartfd, buff, len);
+	len = createbrecord_double(buff, IMR, 0x007FFFFF & ~IMR_MTMR1);
+	writeandreadback(uartfd, buff, len);
+
+	// the stub starts the timer and jumps to runtest which calls the code
+	putlong(&_binary_stub_runtest_start[RUNTEST_ENTRY], address);
+	loadinstructionsintomemory(uartfd, RUNTEST, _binary_stub_runtest_start,
+			sizeof(_binary_stub_runtest_start));
+	loadstub(uartfd, _binary_stub_runwithinterrupts_start,
+			sizeof(_binary_stub_runwithinterrupts_start));
+	printf("profiling code at 0x%"PRIx32", %d samples a second\n", address,
+			rate);
+	startinstructionsinmemory(uartfd, STUBAREA);
+
+	relayconsole(&samples);
+	if (!samples.returned) {
+		write(uartfd, "x", 1);
+		samples.abortsent = true;
+		double deadline = now() + TESTABORTTIMEOUT;
+		while (!samples.returned && !samples.aborted && now() < deadline) {
+			uint8_t c;
+			if (readuarttimeout(uartfd, &c, 1, TESTPOLL) == 1
+					&& profilerbyte(&samples, c))
+				printf("%c", c);
+		}
+	}
+	printf("\n");
+	if (samples.returned || samples.aborted) {
+		finishinstructionsinmemory(uartfd);
+		// the code returned before the abort got to it so the bootloader
+		// has had the byte and echoed it
+		if (samples.abortsent && samples.returned)
+			drainuart(uartfd, linkparams.timeout);
+		len = createbrecord_word(buff, TCTL1, 0);
+		writeandreadback(uartfd, buff, len);
+		len = createbrecord_word(buff, TSTAT1, 0);
+		writeandreadback(uartfd, buff, len);
+		len = createbrecord_double(buff, IMR, 0x007FFFFF);
+		writeandreadback(uartfd, buff, len);
+		if (samples.returned)
+			printf("code returned 0x%"PRIx32"\n", samples.exitcode);
+	} else
+		printf("the code didn't stop, the board needs a reset\n");
+	printprofile(&elf, &samples);
+	free(samples.pcs);
+	freeelf(&elf);
+}
+
+/*
+ * watch samples memory on the board at a fixed rate until it's cancelled.
+ * Samples are timestamped with the board's 32KHz timer so the times are
+ * right even when the uart can't keep up with the rate asked for. Samples
+ * are shown as they come in or logged to a file, as CSV if the name ends
+ * in .csv and otherwise as the timestamp in ticks as a big endian long
+ * followed by the bytes.
+ */
+#define WATCHCLOCK 32768
+#define WATCHMAXLEN 0x100
+#define WATCHSAMPLEMARKER 0xa5
+#define WATCHENDMARKER 0x5a
+#define WATCHSTOPTIMEOUT 1
+#define WATCHMAXSHOWN 16
+
+static void printwatchsample(uint64_t ticks, uint32_t count, double rate,
+		uint8_t* data, int len) {
+	printf("\33[2K\r%.3fs %"PRIu32" samples, %.0f samples/s:",
+			(double) ticks / WATCHCLOCK, count, rate);
+	for (int i = 0; i < len && i < WATCHMAXSHOWN; i++)
+		printf(" %02x", data[i]);
+	if (len > WATCHMAXSHOWN)
+		printf(" ...");
+	fflush(stdout);
+}
+
+static void cmd_watch(char* command) {
+	uint32_t address = 0;
+	int len = 0;
+	int rate = 0;
+	char filepath[256];
+	int args = sscanf(command + 5, " 0x%"SCNx32" %d %d %255s", &address, &len,
+			&rate, filepath);
+	if (args < 3 || len <= 0 || len > WATCHMAXLEN || rate <= 0
+			|| rate > WATCHCLOCK) {
+		printf("bad input\n");
+		return;
+	}
+
+	FILE* file = NULL;
+	bool csv = false;
+	if (args == 4) {
+		int pathlen = strlen(filepath);
+		csv = pathlen > 4 && strcmp(filepath + pathlen - 4, ".csv") == 0;
+		file = fopen(filepath, "w");
+		if (file == NULL) {
+			printf("failed to open output file\n");
+			return;
+		}
+		if (csv) {
+			fprintf(file, "time");
+			for (int i = 0; i < len; i++)
+				fprintf(file, ",0x%08"PRIx32, address + i);
+			fprintf(file, "\n");
+		}
+	}
+
+	uint8_t* stub = _binary_stub_watch_start;
+	putlong(&stub[WATCH_ADDRESS], address);
+	putword(&stub[WATCH_LEN], len);
+	putword(&stub[WATCH_PERIOD], WATCHCLOCK / rate);
+	if (!loadstub(uartfd, stub, sizeof(_binary_stub_watch_start)))
+		patchstub(uartfd, stub, WATCH_ADDRESS, WATCH_PERIOD + 2);
+	printf("watching %d bytes at 0x%"PRIx32", %d samples a second\n", len,
+			address, rate);
+	startinstructionsinmemory(uartfd, STUBAREA);
+
+	uint8_t buff[64];
+	uint8_t sample[3 + WATCHMAXLEN];
+	int have = 0;
+	int skipped = 0;
+	uint32_t count = 0;
+	uint16_t lasttimer = 0;
+	uint64_t ticks = 0;
+	bool stopping = false;
+	bool ended = false;
+	double start = now();
+	double lastshown = 0;
+	double stopdeadline = 0;
+	while (!ended) {
+		// any byte stops the stub, it ends the stream with the end marker
+		if (cancelrequested && !stopping) {
+			write(uartfd, "x", 1);
+			stopping = true;
+			stopdeadline = now() + WATCHSTOPTIMEOUT;
+		} else if (stopping && now() > stopdeadline)
+			break;
+		int got = readuarttimeout(uartfd, buff, sizeof(buff),
+				linkparams.timeout);
+		for (int i = 0; i < got && !ended; i++) {
+			if (have == 0 && buff[i] != WATCHSAMPLEMARKER) {
+				if (stopping && buff[i] == WATCHENDMARKER)
+					ended = true;
+				else
+					skipped++;
+				continue;
+			}
+			sample[have++] = buff[i];
+			if (have < 3 + len)
+				continue;
+			have = 0;
+
+			uint16_t timer = getword(&sample[1]);
+			if (count++ > 0)
+				ticks += (uint16_t) (timer - lasttimer);
+			lasttimer = timer;
+			if (file != NULL && csv) {
+				fprintf(file, "%.6f", (double) ticks / WATCHCLOCK);
+				for (int j = 0; j < len; j++)
+					fprintf(file, ",0x%02x", sample[3 + j]);
+				fprintf(file, "\n");
+			} else if (file != NULL) {
+				uint8_t timestamp[4];
+				putlong(timestamp, ticks);
+				fwrite(timestamp, 1, sizeof(timestamp), file);
+				fwrite(&sample[3], 1, len, file);
+			}
+			// background jobs stay quiet like they do for progress()
+			double t = now();
+			if (currentjob != NULL && !currentjob->background
+					&& t - lastshown > 0.1) {
+				printwatchsample(ticks, count, count / (t - start), &sample[3],
+						len);
+				lastshown = t;
+			}
+		}
+	}
+	if (ended)
+		finishinstructionsinmemory(uartfd);
+	else
+		drainuart(uartfd, linkparams.timeout);
+
+	printf("\n%"PRIu32" samples over %.3fs", count, (double) ticks / WATCHCLOCK);
+	if (skipped > 0)
+		printf(", %d bytes skipped to find the next sample", skipped);
+	printf("\n");
+	if (!ended)
+		printf("the watch didn't stop, the board needs a reset\n");
+	if (file != NULL)
+		fclose(file);
+}
+
+/*
+ * t runs a suite of test programs listed in a manifest, one per line:
+ *
+ * <address> <file> [timeout in seconds] [sentinel]
+ *
+ * Each test is uploaded, skipping blocks that are already on the board,
+ * and called as a subroutine by runtest. The output is captured until the
+ * test returns, prints the sentinel or times out. In the last two cases a
+ * byte is sent to abort it so the board is back in the bootloader for the
+ * next one. A test passes if it printed the sentinel, or returned 0 if
+ * there isn't one, and printed exactly what's in <file>.expected if that
+ * exists. Results are written as JSON, one line per test.
+ *
+ * runtest's records share the uart with the test's output so a test can't
+ * print TESTRETURNMARKER, it will be taken for the test returning. A
+ * TESTABORTMARKER is only looked for once the abort has been sent.
+ */
+#define TESTDEFAULTTIMEOUT 10
+#define TESTMAXOUTPUT 0x10000
+#define TESTEXPECTEDSUFFIX ".expected"
+
+enum testresult {
+	TEST_PASS, TEST_FAIL, TEST_TIMEOUT, TEST_CANCELLED, TEST_ERROR, TEST_HUNG
+};
+
+static const char* testresults[] = { "pass", "fail", "timeout", "cancelled",
+		"error", "hung" };
+
+struct test {
+	uint32_t address;
+	char file[256];
+	int timeout;
+	char sentinel[256];
+	enum testresult result;
+	int uploaded;
+	bool returned;
+	uint32_t exitcode;
+	double seconds;
+	char* output;
+	int outputlen;
+};
+
+// returns how many bytes had to be sent or -1 if the upload failed
+static int uploadtest(const char* path, uint32_t address) {
+	FILE* f = fopen(path, "r");
+	if (f == NULL) {
+		printf("failed to open \"%s\"\n", path);
+		return -1;
+	}
+	struct stat st;
+	if (fstat(fileno(f), &st) != 0) {
+		printf("failed to stat \"%s\"\n", path);
+		fclose(f);
+		return -1;
+	}
+	if (st.st_size == 0) {
+		printf("\"%s\" is empty\n", path);
+		fclose(f);
+		return -1;
+	}
+	if (!checkstubarea(address, st.st_size)) {
+		fclose(f);
+		return -1;
+	}
+	uint8_t* image = malloc(st.st_size);
+	size_t read = fread(image, 1, st.st_size, f);
+	fclose(f);
+
+	int blocks = (read + UBSTATEBLOCK - 1) / UBSTATEBLOCK;
+	uint16_t boardcrcs[blocks];
+	// without the CRCs every block has to go
+	bool havecrcs = readblockcrcs(uartfd, address, read, UBSTATEBLOCK,
+			boardcrcs);
+	int sent = 0;
+	for (int b = 0; b < blocks; b++) {
+		uint32_t offset = b * UBSTATEBLOCK;
+		int len = read - offset;
+		if (len > UBSTATEBLOCK)
+			len = UBSTATEBLOCK;
+		if (havecrcs && crc16(0xffff, image + offset, len) == boardcrcs[b])
+			continue;
+		if (!uploadverifiedblock(address + offset, image + offset, len)) {
+			printf("block at 0x%"PRIx32" failed to verify\n",
+					address + offset);
+			sent = -1;
+			break;
+		}
+		sent += len;
+	}
+	free(image);
+	return sent;
+}
+
+static bool testoutputmatches(struct test* test) {
+	char path[PATH_MAX];
+	snprintf(path, sizeof(path), "%s"TESTEXPECTEDSUFFIX, test->file);
+	FILE* f = fopen(path, "r");
+	if (f == NULL)
+		return true;
+	char* expected = malloc(TESTMAXOUTPUT + 1);
+	size_t len = fread(expected, 1, TESTMAXOUTPUT + 1, f);
+	fclose(f);
+	bool matches = len == test->outputlen
+			&& memcmp(expected, test->output, len) == 0;
+	free(expected);
+	return matches;
+}
+
+static void runtestprogram(struct test* test) {
+	test->uploaded = uploadtest(test->file, test->address);
+	if (test->uploaded < 0) {
+		test->uploaded = 0;
+		test->result = TEST_ERROR;
+		return;
+	}
+
+	putlong(&_binary_stub_runtest_start[RUNTEST_ENTRY], test->address);
+	loadinstructionsintomemory(uartfd, RUNTEST, _binary_stub_runtest_start,
+			sizeof(_binary_stub_runtest_start));
+	startinstructionsinmemory(uartfd, RUNTEST);
+	// the test can write anywhere, stubs included
+	loadedstub = NULL;
+
+	int sentinellen = strlen(test->sentinel);
+	bool sentinelseen = false;
+	bool timedout = false;
+	bool cancelled = false;
+	bool finished = false;
+	int exitbytes = -1;
+	double start = now();
+	double abortdeadline = 0;
+	while (!finished) {
+		double t = now();
+		if (abortdeadline == 0) {
+			timedout = !sentinelseen && t - start > test->timeout;
+			cancelled = !sentinelseen && cancelrequested;
+			if (sentinelseen || timedout || cancelled) {
+				write(uartfd, "x", 1);
+				abortdeadline = t + TESTABORTTIMEOUT;
+			}
+		} else if (t > abortdeadline) {
+			// interrupts are off or the vector got trashed
+			test->result = TEST_HUNG;
+			test->seconds = t - start;
+			return;
+		}
+
+		uint8_t buff[64];
+		int got = readuarttimeout(uartfd, buff, sizeof(buff), TESTPOLL);
+		for (int i = 0; i < got && !finished; i++) {
+			if (exitbytes >= 0) {
+				test->exitcode = (test->exitcode << 8) | buff[i];
+				if (++exitbytes == 4) {
+					test->returned = true;
+					finished = true;
+				}
+			} else if (buff[i] == TESTRETURNMARKER)
+				exitbytes = 0;
+			else if (buff[i] == TESTABORTMARKER && abortdeadline != 0)
+				finished = true;
+			else if (!sentinelseen && test->outputlen < TESTMAXOUTPUT) {
+				test->output[test->outputlen++] = buff[i];
+				sentinelseen = sentinellen > 0
+						&& test->outputlen >= sentinellen
+						&& memcmp(test->output + test->outputlen - sentinellen,
+								test->sentinel, sentinellen) == 0;
+			}
+		}
+	}
+	finishinstructionsinmemory(uartfd);
+	// the test returned before the abort got to it so the bootloader has
+	// had the byte and echoed it
+	if (abortdeadline != 0 && test->returned)
+		drainuart(uartfd, linkparams.timeout);
+	test->seconds = now() - start;
+
+	if (cancelled)
+		test->result = TEST_CANCELLED;
+	else if (timedout)
+		test->result = TEST_TIMEOUT;
+	else if ((sentinellen > 0 ?
+			sentinelseen : test->returned && test->exitcode == 0)
+			&& testoutputmatches(test))
+		test->result = TEST_PASS;
+	else
+		test->result = TEST_FAIL;
+}
+
+static void printjsonstring(FILE* f, const char* str, int len) {
+	fputc('"', f);
+	for (int i = 0; i < len; i++) {
+		uint8_t c = str[i];
+		if (c == '"' || c == '\\')
+			fprintf(f, "\\%c", c);
+		else if (c == '\n')
+			fprintf(f, "\\n");
+		else if (c < 0x20 || c >= 0x7f)
+			fprintf(f, "\\u%04x", c);
+		else
+			fputc(c, f);
+	}
+	fputc('"', f);
+}
+
+static void printtestresult(FILE* f, struct test* test) {
+	fprintf(f, "{\"test\": ");
+	printjsonstring(f, test->file, strlen(test->file));
+	fprintf(f, ", \"address\": \"0x%08"PRIx32"\", \"result\": \"%s\", "
+			"\"uploaded\": %d, \"seconds\": %.3f, \"exitcode\": ",
+			test->address, testresults[test->result], test->uploaded,
+			test->seconds);
+	if (test->returned)
+		fprintf(f, "%"PRId32, (int32_t) test->exitcode);
+	else
+		fprintf(f, "null");
+	fprintf(f, ", \"output\": ");
+	printjsonstring(f, test->output, test->outputlen);
+	fprintf(f, "}\n");
+	fflush(f);
+}
+
+static void cmd_test(char* command) {
+	char manifestpath[256];
+	char resultspath[256];
+	int args = sscanf(command + 1, " %255s %255s", manifestpath, resultspath);
+	if (args < 1) {
+		printf("bad input\n");
+		return;
+	}
+	FILE* manifest = fopen(manifestpath, "r");
+	if (manifest == NULL) {
+		printf("failed to open \"%s\"\n", manifestpath);
+		return;
+	}
+	FILE* results = stdout;
+	if (args == 2) {
+		results = fopen(resultspath, "w");
+		if (results == NULL) {
+			printf("failed to open \"%s\"\n", resultspath);
+			fclose(manifest);
+			return;
+		}
+	}
+
+	int counts[TEST_HUNG + 1] = { 0 };
+	int numtests = 0;
+	int linenum = 0;
+	char line[1024];
+	char* output = malloc(TESTMAXOUTPUT);
+	double start = now();
+	while (!cancelrequested && fgets(line, sizeof(line), manifest) != NULL) {
+		linenum++;
+		if (line[0] == '#')
+			continue;
+		struct test test = { .timeout = TESTDEFAULTTIMEOUT, .output = output };
+		int fields = sscanf(line, " 0x%"SCNx32" %255s %d %255[^\n]",
+				&test.address, test.file, &test.timeout, test.sentinel);
+		if (fields < 0)
+			continue;
+		if (fields < 2) {
+			printf("bad line %d in \"%s\"\n", linenum, manifestpath);
+			continue;
+		}
+		int sentinellen = strlen(test.sentinel);
+		while (sentinellen > 0 && isspace(test.sentinel[sentinellen - 1]))
+			test.sentinel[--sentinellen] = '\0';
+
+		runtestprogram(&test);
+		numtests++;
+		counts[test.result]++;
+		printf("%s: %s in %.3fs, %d bytes uploaded\n", test.file,
+				testresults[test.result], test.seconds, test.uploaded);
+		printtestresult(results, &test);
+		if (test.result == TEST_HUNG) {
+			printf("%s didn't stop when asked, the board needs a reset\n",
+					test.file);
+			break;
+		}
+	}
+	printf("%d tests in %.3fs", numtests, now() - start);
+	for (int i = 0; i <= TEST_HUNG; i++)
+		if (counts[i] > 0)
+			printf(", %d %s", counts[i], testresults[i]);
+	printf("\n");
+	free(output);
+	fclose(manifest);
+	if (results != stdout)
+		fclose(results);
+}
+
+/*
+ * gs bridges gdb's remote serial protocol to the board. gdbmonitor sits at
+ * GDBMONITOR with the trace, trap #15 and illegal instruction vectors
+ * pointing at it. When the code stops the monitor saves the registers, sends
+ * GDBSTOPMARKER and the signal and goes back into the bootloader so memory
+ * can be read and written with the usual stubs until gdb resumes it.
+ */
+#define GDBSAVEAREA (GDBMONITOR + 0x100)
+#define GDBRESUME (GDBMONITOR + GDBMONITOR_RESUME)
+#define GDBTRACEENTRY (GDBMONITOR + GDBMONITOR_TRACE)
+#define GDBTRAP15ENTRY (GDBMONITOR + GDBMONITOR_TRAP15)
+#define GDBILLEGALENTRY (GDBMONITOR + GDBMONITOR_ILLEGAL)
+#define TRACEVECTOR (9 * 4)
+#define TRAP15VECTOR (47 * 4)
+#define ILLEGALVECTOR (4 * 4)
+#define GDBSTOPMARKER 0xfd
+// d0 - d7, a0 - a7, sr, pc
+#define GDBNUMREGS 18
+#define GDBSP 15
+#define GDBSR 16
+#define GDBPC 17
+#define SR_T 0x8000
+#define GDBPACKETSIZE 0x1000
+#define GDBSIGTRAP 5
+
+/*
+ * gdb reads memory a few bytes at a time so reads go through a cache of
+ * GDBCACHELINE byte lines. A miss reads up to GDBPREFETCH lines in one go as
+ * the next read is usually just after this one. Writes go through to the
+ * board and the whole lot is thrown away when the code runs.
+ */
+#define GDBCACHELINE 0x100
+#define GDBCACHELINES 64
+#define GDBPREFETCH 4
+// peripherals have side effects, reads from here always go to the board
+#define GDBUNCACHED 0xfffff000
+
+static struct gdbcacheline {
+	bool valid;
+	uint32_t address;
+	uint8_t data[GDBCACHELINE];
+} gdbcache[GDBCACHELINES];
+static int gdbcachenext = 0;
+
+static uint32_t gdbregs[GDBNUMREGS];
+
+static struct gdbcacheline* gdbcachefind(uint32_t line) {
+	for (int i = 0; i < GDBCACHELINES; i++)
+		if (gdbcache[i].valid && gdbcache[i].address == line)
+			return &gdbcache[i];
+	return NULL;
+}
+
+static struct gdbcacheline* gdbcachefill(uint32_t line) {
+	int lines = 1;
+	while (lines < GDBPREFETCH
+			&& line + (lines * GDBCACHELINE) < GDBUNCACHED
+			&& gdbcachefind(line + (lines * GDBCACHELINE)) == NULL)
+		lines++;
+
+	uint8_t buff[GDBPREFETCH * GDBCACHELINE];
+	readmemory(uartfd, line, lines * GDBCACHELINE, buff);
+	struct gdbcacheline* first = NULL;
+	for (int i = 0; i < lines; i++) {
+		struct gdbcacheline* cached = &gdbcache[gdbcachenext];
+		gdbcachenext = (gdbcachenext + 1) % GDBCACHELINES;
+		cached->valid = true;
+		cached->address = line + (i * GDBCACHELINE);
+		memcpy(cached->data, buff + (i * GDBCACHELINE), GDBCACHELINE);
+		if (first == NULL)
+			first = cached;
+	}
+	return first;
+}
+
+static void gdbcacheinvalidate() {
+	for (int i = 0; i < GDBCACHELINES; i++)
+		gdbcache[i].valid = false;
+}
+
+static void gdbreadmemory(uint32_t address, int len, uint8_t* dest) {
+	while (len > 0) {
+		// a read can run from cached memory into GDBUNCACHED
+		if (address >= GDBUNCACHED) {
+			readmemory(uartfd, address, len, dest);
+			return;
+		}
+		uint32_t line = address & ~(GDBCACHELINE - 1);
+		struct gdbcacheline* cached = gdbcachefind(line);
+		if (cached == NULL)
+			cached = gdbcachefill(line);
+		int offset = address - line;
+		int count = GDBCACHELINE - offset;
+		if (count > len)
+			count = len;
+		memcpy(dest, cached->data + offset, count);
+		address += count;
+		dest += count;
+		len -= count;
+	}
+}
+
+// writes are small, breakpoints and variables, so b-records do the job
+static void gdbwritememory(uint32_t address, int len, uint8_t* src) {
+	char brecordbuff[DATABRECORDLEN(BRECORDMAXPAYLOAD)];
+	for (int offset = 0; offset < len; offset += linkparams.brecordpayload) {
+		int count = len - offset;
+		if (count > linkparams.brecordpayload)
+			count = linkparams.brecordpayload;
+		int brecordlen = createbrecord(brecordbuff, address + offset, count,
+				src + offset);
+		writeandreadback(uartfd, brecordbuff, brecordlen);
+	}
+
+	for (int i = 0; i < len; i++) {
+		struct gdbcacheline* cached = gdbcachefind(
+				(address + i) & ~(GDBCACHELINE - 1));
+		if (cached != NULL)
+			cached->data[(address + i) % GDBCACHELINE] = src[i];
+	}
+}
+
+static void gdbreadregisters() {
+	uint8_t buff[GDBNUMREGS * 4];
+	readmemory(uartfd, GDBSAVEAREA, sizeof(buff), buff);
+	for (int i = 0; i < GDBNUMREGS; i++)
+		gdbregs[i] = getlong(buff + (i * 4));
+}
+
+static void gdbwriteregisters() {
+	uint8_t buff[GDBNUMREGS * 4];
+	for (int i = 0; i < GDBNUMREGS; i++)
+		putlong(buff + (i * 4), gdbregs[i]);
+	gdbwritememory(GDBSAVEAREA, sizeof(buff), buff);
+}
+
+static const char hexdigits[] = "0123456789abcdef";
+
+static void tohex(char* dest, const uint8_t* src, int len) {
+	for (int i = 0; i < len; i++) {
+		*dest++ = hexdigits[src[i] >> 4];
+		*dest++ = hexdigits[src[i] & 0xf];
+	}
+	*dest = '\0';
+}
+
+static int fromhex(uint8_t* dest, const char* src, int len) {
+	for (int i = 0; i < len; i++) {
+		unsigned int byte;
+		if (sscanf(src + (i * 2), "%2x", &byte) != 1)
+			return i;
+		dest[i] = byte;
+	}
+	return len;
+}
+
+static void gdbputpacket(int gdbfd, const char* data) {
+	char packet[(GDBPACKETSIZE * 2) + 8];
+	uint8_t checksum = 0;
+	int len = strlen(data);
+	for (int i = 0; i < len; i++)
+		checksum += (uint8_t) data[i];
+	len = snprintf(packet, sizeof(packet), "$%s#%02x", data, checksum);
+	write(gdbfd, packet, len);
+}
+
+/*
+ * Returns the length of the next packet or -1 if gdb went away or the job
+ * was cancelled. Acks and anything else outside of a packet are dropped.
+ */
+static int gdbgetpacket(int gdbfd, char* packet, int size) {
+	struct pollfd gdbpollfd;
+	gdbpollfd.fd = gdbfd;
+	gdbpollfd.events = POLLIN;
+
+	int len = -1;
+	uint8_t checksum = 0;
+	char c;
+	while (!cancelrequested) {
+		if (poll(&gdbpollfd, 1, linkparams.timeout) <= 0)
+			continue;
+		if (read(gdbfd, &c, 1) != 1)
+			return -1;
+		if (c == '$') {
+			len = 0;
+			checksum = 0;
+		} else if (len < 0)
+			continue;
+		else if (c == '#') {
+			char sum[3] = { 0 };
+			unsigned int expected;
+			for (int i = 0; i < 2; i++)
+				if (readuarttimeout(gdbfd, (uint8_t*) &sum[i], 1,
+						linkparams.timeout * 10) != 1)
+					return -1;
+			if (sscanf(sum, "%2x", &expected) == 1 && expected == checksum) {
+				write(gdbfd, "+", 1);
+				packet[len] = '\0';
+				return len;
+			}
+			write(gdbfd, "-", 1);
+			len = -1;
+		} else if (len < size - 1) {
+			packet[len++] = c;
+			checksum += (uint8_t) c;
+		}
+	}
+	return -1;
+}
+
+/*
+ * Run the code until the monitor says it stopped, anything else the board
+ * sends on the way is passed to gdb as console output. Returns the signal or
+ * -1 if gdb went away or the job was cancelled with the code still running.
+ */
+static int gdbresume(int gdbfd, bool step) {
+	if (step)
+		gdbregs[GDBSR] |= SR_T;
+	else
+		gdbregs[GDBSR] &= ~SR_T;
+	gdbwriteregisters();
+	gdbcacheinvalidate();
+	startinstructionsinmemory(uartfd, GDBRESUME);
+	// the code can write anywhere, stubs included
+	loadedstub = NULL;
+
+	struct pollfd fds[2];
+	fds[0].fd = uartfd;
+	fds[0].events = POLLIN;
+	fds[1].fd = gdbfd;
+	fds[1].events = POLLIN;
+	while (!cancelrequested) {
+		if (poll(fds, 2, linkparams.timeout) <= 0)
+			continue;
+		if (fds[0].revents & POLLIN) {
+			uint8_t buff[64];
+			int len = read(uartfd, buff, sizeof(buff));
+			for (int i = 0; i < len; i++) {
+				if (buff[i] != GDBSTOPMARKER)
+					continue;
+				// console output before the marker
+				if (i > 0) {
+					char output[(sizeof(buff) * 2) + 2] = "O";
+					tohex(output + 1, buff, i);
+					gdbputpacket(gdbfd, output);
 				}
+				uint8_t signal;
+				if (i + 1 < len)
+					signal = buff[i + 1];
+				else
+					readuart(uartfd, &signal, 1);
+				finishinstructionsinmemory(uartfd);
+				gdbreadregisters();
+				gdbregs[GDBSR] &= ~SR_T;
+				return signal;
+			}
+			if (len > 0) {
+				char output[(sizeof(buff) * 2) + 2] = "O";
+				tohex(output + 1, buff, len);
+				gdbputpacket(gdbfd, output);
 			}
-			tcsetattr(0, TCSANOW, &otty);
+		}
+		if (fds[1].revents & POLLIN) {
+			char c;
+			if (read(gdbfd, &c, 1) != 1)
+				return -1;
+			// the monitor only gets control back on a trap or trace
+			if (c == 0x03)
+				printf("can't interrupt the board, use a breakpoint\n");
 		}
 	}
+	return -1;
+}
+
+// returns false once gdb is done with the board
+static bool gdbcommand(int gdbfd, char* packet, int len, int* signal) {
+	char reply[(GDBPACKETSIZE * 2) + 1] = "";
+	uint8_t buff[GDBPACKETSIZE];
+	uint32_t address, value;
+	int count;
+	switch (packet[0]) {
+	case '?':
+		snprintf(reply, sizeof(reply), "S%02x", *signal);
+		break;
+	case 'g':
+		for (int i = 0; i < GDBNUMREGS; i++)
+			putlong(buff + (i * 4), gdbregs[i]);
+		tohex(reply, buff, GDBNUMREGS * 4);
+		break;
+	case 'G':
+		count = fromhex(buff, packet + 1, GDBNUMREGS * 4) / 4;
+		for (int i = 0; i < count; i++)
+			gdbregs[i] = getlong(buff + (i * 4));
+		strcpy(reply, "OK");
+		break;
+	case 'p':
+		if (sscanf(packet + 1, "%x", &count) == 1 && count < GDBNUMREGS) {
+			putlong(buff, gdbregs[count]);
+			tohex(reply, buff, 4);
+		} else
+			strcpy(reply, "E01");
+		break;
+	case 'P':
+		if (sscanf(packet + 1, "%x=%"SCNx32, &count, &value) == 2
+				&& count < GDBNUMREGS) {
+			gdbregs[count] = value;
+			strcpy(reply, "OK");
+		} else
+			strcpy(reply, "E01");
+		break;
+	case 'm':
+		if (sscanf(packet + 1, "%"SCNx32",%x", &address, &count) == 2) {
+			if (count > GDBPACKETSIZE)
+				count = GDBPACKETSIZE;
+			gdbreadmemory(address, count, buff);
+			tohex(reply, buff, count);
+		} else
+			strcpy(reply, "E01");
+		break;
+	case 'M': {
+		char* data = strchr(packet, ':');
+		if (sscanf(packet + 1, "%"SCNx32",%x", &address, &count) == 2
+				&& data != NULL && count <= GDBPACKETSIZE
+				&& fromhex(buff, data + 1, count) == count) {
+			stubareawritten(address, count);
+			gdbwritememory(address, count, buff);
+			strcpy(reply, "OK");
+		} else
+			strcpy(reply, "E01");
+		break;
+	}
+	case 'X': {
+		// binary data, }, #, $ and * are escaped with } and xor 0x20
+		char* data = memchr(packet, ':', len);
+		if (sscanf(packet + 1, "%"SCNx32",%x", &address, &count) == 2
+				&& data != NULL && count <= GDBPACKETSIZE) {
+			int got = 0;
+			for (char* c = data + 1; c < packet + len && got < count; c++) {
+				if (*c == '}' && c + 1 < packet + len)
+					buff[got++] = *(++c) ^ 0x20;
+				else
+					buff[got++] = *c;
+			}
+			if (got > 0) {
+				stubareawritten(address, got);
+				gdbwritememory(address, got, buff);
+			}
+			strcpy(reply, "OK");
+		} else
+			strcpy(reply, "E01");
+		break;
+	}
+	case 'c':
+	case 's':
+		if (sscanf(packet + 1, "%"SCNx32, &address) == 1)
+			gdbregs[GDBPC] = address;
+		*signal = gdbresume(gdbfd, packet[0] == 's');
+		if (*signal < 0) {
+			printf("gdb went away with the code still running\n");
+			return false;
+		}
+		snprintf(reply, sizeof(reply), "S%02x", *signal);
+		break;
+	case 'H':
+		strcpy(reply, "OK");
+		break;
+	case 'q':
+		if (strncmp(packet, "qSupported", 10) == 0)
+			snprintf(reply, sizeof(reply), "PacketSize=%x",
+					GDBPACKETSIZE * 2);
+		else if (strcmp(packet, "qAttached") == 0)
+			strcpy(reply, "1");
+		break;
+	case 'D':
+		gdbputpacket(gdbfd, "OK");
+		return false;
+	case 'k':
+		return false;
+	}
+	gdbputpacket(gdbfd, reply);
+	return true;
+}
+
+static void cmd_gdbserver(char* command) {
+	int port;
+	uint32_t entry;
+	if (sscanf(command + 2, " %d 0x%"SCNx32, &port, &entry) != 2) {
+		printf("bad input\n");
+		return;
+	}
+
+	int listenfd = socket(AF_INET, SOCK_STREAM, 0);
+	int on = 1;
+	setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(port);
+	if (bind(listenfd, (struct sockaddr*) &addr, sizeof(addr)) < 0
+			|| listen(listenfd, 1) < 0) {
+		printf("failed to listen on port %d\n", port);
+		close(listenfd);
+		return;
+	}
+
+	char buff[64];
+	int len;
+	loadinstructionsintomemory(uartfd, GDBMONITOR, _binary_stub_gdbmonitor_start,
+			sizeof(_binary_stub_gdbmonitor_start));
+	len = createbrecord_double(buff, TRACEVECTOR, GDBTRACEENTRY);
+	writeandreadback(uartfd, buff, len);
+	len = createbrecord_double(buff, TRAP15VECTOR, GDBTRAP15ENTRY);
+	writeandreadback(uartfd, buff, len);
+	len = createbrecord_double(buff, ILLEGALVECTOR, GDBILLEGALENTRY);
+	writeandreadback(uartfd, buff, len);
+
+	// the code hasn't started yet, give it a stack below the scratch area
+	memset(gdbregs, 0, sizeof(gdbregs));
+	gdbregs[GDBSP] = SCRATCHAREA;
+	gdbregs[GDBSR] = 0x2700;
+	gdbregs[GDBPC] = entry;
+	gdbcacheinvalidate();
+
+	printf("waiting for gdb on port %d, code at 0x%"PRIx32"\n", port, entry);
+	struct pollfd listenpollfd;
+	listenpollfd.fd = listenfd;
+	listenpollfd.events = POLLIN;
+	while (!cancelrequested && poll(&listenpollfd, 1, linkparams.timeout) <= 0)
+		;
+	int gdbfd = cancelrequested ? -1 : accept(listenfd, NULL, NULL);
+	close(listenfd);
+	if (gdbfd < 0)
+		return;
+	// the packets are tiny and every one is waited on
+	setsockopt(gdbfd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+	printf("gdb connected\n");
+
+	char packet[(GDBPACKETSIZE * 2) + 64];
+	int signal = GDBSIGTRAP;
+	while ((len = gdbgetpacket(gdbfd, packet, sizeof(packet))) >= 0
+			&& gdbcommand(gdbfd, packet, len, &signal))
+		;
+	close(gdbfd);
+	printf("gdb disconnected\n");
+}
+
+// these all replace the plain transfers so only one of them can be on
+static struct {
+	const char* name;
+	bool* value;
+} options[] = { { "rle", &rlereadback }, { "crc", &framedtransfers }, {
+		"dual", &dualtransfers } };
+
+static void cmd_set(char* command) {
+	char option[32];
+	char value[8];
+	if (sscanf(command + 1, " %31s %7s", option, value) == 2) {
+		for (int i = 0; i < sizeof(options) / sizeof(options[0]); i++) {
+			if (strcmp(option, options[i].name) == 0) {
+				bool on = strcmp(value, "on") == 0;
+				for (int j = 0; on && j < sizeof(options) / sizeof(options[0]);
+						j++) {
+					if (j != i && *options[j].value) {
+						printf("%s is on, turn it off first\n",
+								options[j].name);
+						return;
+					}
+				}
+				*options[i].value = on;
+				printf("%s %s\n", options[i].name,
+						*options[i].value ? "on" : "off");
+				return;
+			}
+		}
+		printf("unknown option \"%s\"\n", option);
+	} else
+		printf("bad input\n");
 }
 
 static bool parsecmd(char* command) {
 	printf("parsing command %s\n", command);
 	bool ret = true;
+	loadedstub = NULL;
 	switch (command[0]) {
 	case 'e':
 		return false;
@@ -808,11 +3420,41 @@ static bool parsecmd(char* command) {
 		break;
 
 	case 'r':
-		cmd_go(command, true);
+		if (command[1] == 'p')
+			cmd_profile(command);
+		else
+			cmd_go(command, true);
 		break;
 	case 'g':
-		cmd_go(command, false);
-		ret = false;
+		if (command[1] == 's')
+			cmd_gdbserver(command);
+		else {
+			cmd_go(command, false);
+			ret = false;
+		}
+		break;
+	case 'w':
+		if (strncmp(command, "watch", 5) == 0)
+			cmd_watch(command);
+		else
+			printf("bad input\n");
+		break;
+	case 't':
+		cmd_test(command);
+		break;
+	case 'c':
+		if (strncmp(command, "cmp", 3) == 0)
+			cmd_compare(command);
+		else if (command[1] == 'p')
+			cmd_copy(command);
+		else
+			printf("bad input\n");
+		break;
+	case 'a':
+		cmd_autotune(command);
+		break;
+	case 's':
+		cmd_set(command);
 		break;
 	case '?':
 		printhelp();
@@ -827,18 +3469,207 @@ static bool parsecmd(char* command) {
 	return ret;
 }
 
-int main(int argc, char** argv) {
+static void* worker(void* arg) {
+	pthread_mutex_lock(&jobslock);
+	while (true) {
+		while (nextjobtorun == nextjobid)
+			pthread_cond_wait(&jobscond, &jobslock);
+		struct job* job = &jobs[nextjobtorun++ % MAXJOBS];
+		if (job->state == JOB_CANCELLED) {
+			pthread_cond_broadcast(&jobscond);
+			continue;
+		}
+		job->state = JOB_RUNNING;
+		job->what = NULL;
+		job->start = now();
+		cancelrequested = false;
+		currentjob = job;
+		pthread_mutex_unlock(&jobslock);
+
+		bool ret = parsecmd(job->command);
+
+		pthread_mutex_lock(&jobslock);
+		currentjob = NULL;
+		job->ret = ret;
+		job->state = cancelrequested ? JOB_CANCELLED : JOB_DONE;
+		if (job->background)
+			printf("[%d] %s\t%s", job->id, jobstates[job->state],
+					job->command);
+		pthread_cond_broadcast(&jobscond);
+	}
+	return NULL;
+}
 
-	char buff[64];
+/*
+ * ctrl-c cancels whatever is running, if nothing is or the job is already
+ * being cancelled and has got stuck it's the usual ctrl-c
+ */
+static void interrupt(int sig) {
+	if (currentjob != NULL && !cancelrequested)
+		cancelrequested = true;
+	else {
+		signal(SIGINT, SIG_DFL);
+		raise(SIGINT);
+	}
+}
 
-	int len;
+static bool jobfinished(struct job* job) {
+	return job->state == JOB_DONE || job->state == JOB_CANCELLED;
+}
 
-	uartfd = open("/dev/ttyUSB0", O_RDWR | O_NOCTTY);
-	if (uartfd < 0) {
-		printf("failed to open uart\n");
-		return 1;
+static struct job* findjob(int id) {
+	struct job* job = &jobs[id % MAXJOBS];
+	return (id > 0 && job->id == id) ? job : NULL;
+}
+
+static struct job* queuejob(char* command, bool background) {
+	pthread_mutex_lock(&jobslock);
+	struct job* job = &jobs[nextjobid % MAXJOBS];
+	if (job->id != 0 && !jobfinished(job)) {
+		pthread_mutex_unlock(&jobslock);
+		printf("too many jobs queued\n");
+		return NULL;
+	}
+	memset(job, 0, sizeof(*job));
+	job->id = nextjobid++;
+	snprintf(job->command, sizeof(job->command), "%s", command);
+	job->background = background;
+	job->state = JOB_QUEUED;
+	pthread_cond_broadcast(&jobscond);
+	pthread_mutex_unlock(&jobslock);
+	return job;
+}
+
+// wait for one job or, if job is NULL, for everything that has been queued
+static void waitjob(struct job* job) {
+	pthread_mutex_lock(&jobslock);
+	if (job != NULL) {
+		int id = job->id;
+		while (job->id == id && !jobfinished(job))
+			pthread_cond_wait(&jobscond, &jobslock);
+	} else {
+		while (nextjobtorun != nextjobid || currentjob != NULL)
+			pthread_cond_wait(&jobscond, &jobslock);
+	}
+	pthread_mutex_unlock(&jobslock);
+}
+
+static void cmd_jobs() {
+	pthread_mutex_lock(&jobslock);
+	for (int id = nextjobid - MAXJOBS; id < nextjobid; id++) {
+		struct job* job = findjob(id);
+		if (job == NULL)
+			continue;
+		printf("[%d] %s\t", job->id, jobstates[job->state]);
+		if (job->state == JOB_RUNNING && job->what != NULL) {
+			printprogress(job);
+			printf("\t");
+		}
+		printf("%s", job->command);
+	}
+	pthread_mutex_unlock(&jobslock);
+}
+
+// returns false if a job was given but doesn't exist
+static bool jobarg(char* args, struct job** job) {
+	int id;
+	*job = NULL;
+	if (sscanf(args, " %d", &id) != 1)
+		return true;
+	*job = findjob(id);
+	if (*job == NULL)
+		printf("no job %d\n", id);
+	return *job != NULL;
+}
+
+static void cmd_cancel(char* command) {
+	struct job* job;
+	if (!jobarg(command + 6, &job))
+		return;
+	pthread_mutex_lock(&jobslock);
+	if (job == NULL)
+		job = currentjob;
+	// or the next one to run if the worker hasn't picked it up yet
+	if (job == NULL && nextjobtorun != nextjobid)
+		job = findjob(nextjobtorun);
+	if (job == NULL)
+		printf("nothing to cancel\n");
+	else if (job->state == JOB_QUEUED) {
+		job->state = JOB_CANCELLED;
+		printf("[%d] cancelled\n", job->id);
+		pthread_cond_broadcast(&jobscond);
+	} else if (job->state == JOB_RUNNING) {
+		// the job stops at the end of the block it's on
+		cancelrequested = true;
+		printf("[%d] cancelling\n", job->id);
+	}
+	pthread_mutex_unlock(&jobslock);
+}
+
+static void cmd_wait(char* command) {
+	struct job* job;
+	if (jobarg(command + 4, &job))
+		waitjob(job);
+}
+
+/*
+ * Commands are queued for the worker, anything ending in & runs in the
+ * background and the shell comes straight back. jobs, cancel and wait are
+ * handled here so they work while the worker is busy.
+ */
+static bool shellcmd(char* command) {
+	if (strncmp(command, "jobs", 4) == 0) {
+		cmd_jobs();
+		return true;
+	}
+	if (strncmp(command, "cancel", 6) == 0) {
+		cmd_cancel(command);
+		return true;
+	}
+	if (strncmp(command, "wait", 4) == 0) {
+		cmd_wait(command);
+		return true;
+	}
+	if (command[0] == '?') {
+		printhelp();
+		return true;
+	}
+	if (command[0] == 'e') {
+		waitjob(NULL);
+		return false;
 	}
 
+	bool background = false;
+	char* end = command + strlen(command);
+	while (end > command && (end[-1] == '\n' || end[-1] == ' '))
+		end--;
+	if (end > command && end[-1] == '&') {
+		if (command[0] == 'r' || (command[0] == 'g' && command[1] != 's')) {
+			printf("r and g can only run in the foreground\n");
+			return true;
+		}
+		background = true;
+		end--;
+		while (end > command && end[-1] == ' ')
+			end--;
+		strcpy(end, "\n");
+	}
+
+	struct job* job = queuejob(command, background);
+	if (job == NULL)
+		return true;
+	if (background) {
+		printf("[%d] queued\n", job->id);
+		return true;
+	}
+	waitjob(job);
+	return job->ret;
+}
+
+static void startup(int uartfd) {
+	char buff[64];
+	int len;
+
 	uartsetup(uartfd, B19200);
 
 	printf("press reset button now!\n");
@@ -874,6 +3705,60 @@ int main(int argc, char** argv) {
 	runinit(uartfd);
 	ledson(uartfd);
 	printf("init brecords done..\n");
+}
+
+int main(int argc, char** argv) {
+	const char* device = "/dev/ttyUSB0";
+	int opt;
+	const char* device2 = NULL;
+	bool skipstartup = false;
+	while ((opt = getopt(argc, argv, "d:D:n")) != -1) {
+		switch (opt) {
+		case 'd':
+			device = optarg;
+			break;
+		case 'D':
+			device2 = optarg;
+			break;
+		case 'n':
+			skipstartup = true;
+			break;
+		default:
+			printf("usage: %s [-d serial device] [-D uart 2 serial device] "
+					"[-n]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	uartfd = open(device, O_RDWR | O_NOCTTY);
+	if (uartfd < 0) {
+		printf("failed to open uart\n");
+		return 1;
+	}
+	if (device2 != NULL) {
+		uartfd2 = open(device2, O_RDWR | O_NOCTTY);
+		if (uartfd2 < 0) {
+			printf("failed to open uart 2\n");
+			return 1;
+		}
+	}
+
+	findadapterkey(device);
+	loadlinkparams();
+
+	/*
+	 * -n skips the reset, handshake and init for a target that is already
+	 * sitting in the bootloader at 115200 with the init done, like an
+	 * emulated board on a pty or one left running by an earlier session.
+	 */
+	if (skipstartup) {
+		uartsetup(uartfd, B115200);
+		printf("skipping the board startup\n");
+	} else
+		startup(uartfd);
+
+	if (uartfd2 >= 0)
+		dualsetup(uartfd);
 
 //	printf("testing instruction buffer\n");
 //	ledsoff(uartfd);
@@ -887,15 +3772,23 @@ int main(int argc, char** argv) {
 	ledson(uartfd);
 	printf("done\n");
 
+	pthread_t workerthread;
+	pthread_create(&workerthread, NULL, worker, NULL);
+	signal(SIGINT, interrupt);
+
 	bool exit = false;
 	char cmdbuff[256];
 	while (!exit) {
 		fputs(">", stdout);
-		fgets(cmdbuff, sizeof(cmdbuff), stdin);
-		exit = !parsecmd(cmdbuff);
+		fflush(stdout);
+		if (fgets(cmdbuff, sizeof(cmdbuff), stdin) == NULL)
+			strcpy(cmdbuff, "e\n");
+		exit = !shellcmd(cmdbuff);
 	}
 
 	close(uartfd);
+	if (uartfd2 >= 0)
+		close(uartfd2);
 
 	return 0;
 }
@@ -0,0 +1,15 @@
+#include <stdint.h>
+uint8_t _binary_stub_comparememory_start[148] = {
+ 0x4d, 0xf9, 0xaa, 0xaa, 0xaa, 0xaa, 0x4b, 0xf9, 0xbb, 0xbb, 0xbb, 0xbb,
+ 0x2e, 0x3c, 0xcc, 0xcc, 0xcc, 0xcc, 0x20,  0xe, 0x22,  0xd, 0xb3, 0x80,
+  0x8,  0x0,  0x0,  0x0, 0x66, 0x2e, 0x20,  0xe,  0x8,  0x0,  0x0,  0x0,
+ 0x67,  0xa, 0x4a, 0x87, 0x67, 0x34, 0xbd,  0xd, 0x66, 0x3c, 0x53, 0x87,
+ 0x2c,  0x7, 0xe4, 0x8e,  0x2, 0x87,  0x0,  0x0,  0x0,  0x3, 0x60,  0x4,
+ 0xbd, 0x8d, 0x66, 0x22, 0x51, 0xce, 0xff, 0xfa,  0x4, 0x86,  0x0,  0x1,
+  0x0,  0x0, 0x64, 0xf0, 0x60,  0x4, 0xbd,  0xd, 0x66, 0x18, 0x51, 0xcf,
+ 0xff, 0xfa,  0x4, 0x87,  0x0,  0x1,  0x0,  0x0, 0x64, 0xf0, 0x72,  0x0,
+ 0x60,  0xc, 0x59, 0x8e, 0x59, 0x8d, 0xbd,  0xd, 0x67, 0xfc, 0x53, 0x8e,
+ 0x72,  0x1, 0x11, 0xc1, 0xf9,  0x7,  0x8, 0x38,  0x0,  0x2, 0xf9,  0x6,
+ 0x66, 0xf8, 0x20,  0xe, 0x76,  0x3, 0xe1, 0x98, 0x11, 0xc0, 0xf9,  0x7,
+  0x8, 0x38,  0x0,  0x2, 0xf9,  0x6, 0x66, 0xf8, 0x51, 0xcb, 0xff, 0xf0,
+ 0x4e, 0xf8, 0xff, 0x5a };
@@ -0,0 +1,4 @@
+uint8_t _binary_stub_comparememory_start[148];
+#define COMPAREMEMORY_A 0x00000002
+#define COMPAREMEMORY_B 0x00000008
+#define COMPAREMEMORY_LEN 0x0000000e
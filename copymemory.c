@@ -0,0 +1,17 @@
+#include <stdint.h>
+uint8_t _binary_stub_copymemory_start[176] = {
+ 0x4d, 0xf9, 0xaa, 0xaa, 0xaa, 0xaa, 0x4b, 0xf9, 0xbb, 0xbb, 0xbb, 0xbb,
+ 0x2e, 0x3c, 0xcc, 0xcc, 0xcc, 0xcc, 0x3a, 0x3c, 0xdd, 0xdd, 0x66, 0x4a,
+ 0x20,  0xe, 0x22,  0xd, 0xb3, 0x80,  0x8,  0x0,  0x0,  0x0, 0x66, 0x2a,
+ 0x20,  0xe,  0x8,  0x0,  0x0,  0x0, 0x67,  0x8, 0x4a, 0x87, 0x67, 0x2e,
+ 0x1a, 0xde, 0x53, 0x87, 0x2c,  0x7, 0xe4, 0x8e,  0x2, 0x87,  0x0,  0x0,
+  0x0,  0x3, 0x60,  0x2, 0x2a, 0xde, 0x51, 0xce, 0xff, 0xfc,  0x4, 0x86,
+  0x0,  0x1,  0x0,  0x0, 0x64, 0xf2, 0x60,  0x2, 0x1a, 0xde, 0x51, 0xcf,
+ 0xff, 0xfc,  0x4, 0x87,  0x0,  0x1,  0x0,  0x0, 0x64, 0xf2, 0x4e, 0xf8,
+ 0xff, 0x5a, 0xdd, 0xc7, 0xdb, 0xc7, 0x20,  0xe, 0x22,  0xd, 0xb3, 0x80,
+  0x8,  0x0,  0x0,  0x0, 0x66, 0x2a, 0x20,  0xe,  0x8,  0x0,  0x0,  0x0,
+ 0x67,  0x8, 0x4a, 0x87, 0x67, 0x2e, 0x1b, 0x26, 0x53, 0x87, 0x2c,  0x7,
+ 0xe4, 0x8e,  0x2, 0x87,  0x0,  0x0,  0x0,  0x3, 0x60,  0x2, 0x2b, 0x26,
+ 0x51, 0xce, 0xff, 0xfc,  0x4, 0x86,  0x0,  0x1,  0x0,  0x0, 0x64, 0xf2,
+ 0x60,  0x2, 0x1b, 0x26, 0x51, 0xcf, 0xff, 0xfc,  0x4, 0x87,  0x0,  0x1,
+  0x0,  0x0, 0x64, 0xf2, 0x4e, 0xf8, 0xff, 0x5a };
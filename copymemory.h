@@ -0,0 +1,5 @@
+uint8_t _binary_stub_copymemory_start[176];
+#define COPYMEMORY_BACKWARDS 0x00000014
+#define COPYMEMORY_DST 0x00000008
+#define COPYMEMORY_LEN 0x0000000e
+#define COPYMEMORY_SRC 0x00000002
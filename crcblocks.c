@@ -0,0 +1,10 @@
+#include <stdint.h>
+uint8_t _binary_stub_crcblocks_start[88] = {
+ 0x2e, 0x3c, 0xaa, 0xaa, 0xaa, 0xaa, 0x4d, 0xf9, 0xaa, 0xaa, 0xaa, 0xaa,
+ 0x74, 0xff, 0x2c, 0x3c,  0x0,  0x0, 0x10,  0x0, 0xbc, 0x87, 0x63,  0x2,
+ 0x2c,  0x7, 0x9e, 0x86, 0x10, 0x1e, 0xe1, 0x48, 0xb1, 0x42, 0x78,  0x7,
+ 0xd4, 0x42, 0x64,  0x4,  0xa, 0x42, 0x10, 0x21, 0x51, 0xcc, 0xff, 0xf6,
+ 0x53, 0x86, 0x66, 0xe8, 0x30,  0x2, 0xe0, 0x48, 0x11, 0xc0, 0xf9,  0x7,
+  0x8, 0x38,  0x0,  0x2, 0xf9,  0x6, 0x66, 0xf8, 0x11, 0xc2, 0xf9,  0x7,
+  0x8, 0x38,  0x0,  0x2, 0xf9,  0x6, 0x66, 0xf8, 0x4a, 0x87, 0x66, 0xb8,
+ 0x4e, 0xf8, 0xff, 0x5a };
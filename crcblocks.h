@@ -0,0 +1,4 @@
+uint8_t _binary_stub_crcblocks_start[88];
+#define CRCBLOCKS_ADDRESS 0x00000008
+#define CRCBLOCKS_BLOCKSIZE 0x00000010
+#define CRCBLOCKS_LEN 0x00000002
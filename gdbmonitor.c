@@ -0,0 +1,13 @@
+#include <stdint.h>
+uint8_t _binary_stub_gdbmonitor_start[128] = {
+ 0x13, 0xfc,  0x0,  0x5,  0x1, 0xff, 0xfd, 0x4c, 0x60, 0x12, 0x13, 0xfc,
+  0x0,  0x5,  0x1, 0xff, 0xfd, 0x4c, 0x60,  0x8, 0x13, 0xfc,  0x0,  0x4,
+  0x1, 0xff, 0xfd, 0x4c, 0x48, 0xf9, 0x7f, 0xff,  0x1, 0xff, 0xfd,  0x0,
+ 0x33, 0xdf,  0x1, 0xff, 0xfd, 0x42, 0x23, 0xdf,  0x1, 0xff, 0xfd, 0x44,
+ 0x23, 0xcf,  0x1, 0xff, 0xfd, 0x3c, 0x2e, 0x79,  0x1, 0xff, 0xfd, 0x48,
+  0x8, 0x38,  0x0,  0x5, 0xf9,  0x6, 0x67, 0xf8, 0x11, 0xfc,  0x0, 0xfd,
+ 0xf9,  0x7,  0x8, 0x38,  0x0,  0x5, 0xf9,  0x6, 0x67, 0xf8, 0x11, 0xf9,
+  0x1, 0xff, 0xfd, 0x4c, 0xf9,  0x7, 0x4e, 0xf8, 0xff, 0x5a, 0x23, 0xcf,
+  0x1, 0xff, 0xfd, 0x48, 0x2e, 0x79,  0x1, 0xff, 0xfd, 0x3c, 0x2f, 0x39,
+  0x1, 0xff, 0xfd, 0x44, 0x3f, 0x39,  0x1, 0xff, 0xfd, 0x42, 0x4c, 0xf9,
+ 0x7f, 0xff,  0x1, 0xff, 0xfd,  0x0, 0x4e, 0x73 };
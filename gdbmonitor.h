@@ -0,0 +1,5 @@
+uint8_t _binary_stub_gdbmonitor_start[128];
+#define GDBMONITOR_ILLEGAL 0x00000014
+#define GDBMONITOR_RESUME 0x0000005e
+#define GDBMONITOR_TRACE 0x00000000
+#define GDBMONITOR_TRAP15 0x0000000a
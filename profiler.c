@@ -0,0 +1,10 @@
+#include <stdint.h>
+uint8_t _binary_stub_profiler_start[88] = {
+ 0x2f,  0x1, 0x4a, 0x78, 0xf6,  0xa, 0x42, 0x78, 0xf6,  0xa, 0x22, 0x2f,
+  0x0,  0x6,  0x8, 0x38,  0x0,  0x5, 0xf9,  0x6, 0x67, 0xf8, 0x11, 0xfc,
+  0x0, 0xfe, 0xf9,  0x7,  0x8, 0x38,  0x0,  0x5, 0xf9,  0x6, 0x67, 0xf8,
+ 0xe1, 0x99, 0x11, 0xc1, 0xf9,  0x7,  0x8, 0x38,  0x0,  0x5, 0xf9,  0x6,
+ 0x67, 0xf8, 0xe1, 0x99, 0x11, 0xc1, 0xf9,  0x7,  0x8, 0x38,  0x0,  0x5,
+ 0xf9,  0x6, 0x67, 0xf8, 0xe1, 0x99, 0x11, 0xc1, 0xf9,  0x7,  0x8, 0x38,
+  0x0,  0x5, 0xf9,  0x6, 0x67, 0xf8, 0xe1, 0x99, 0x11, 0xc1, 0xf9,  0x7,
+ 0x22, 0x1f, 0x4e, 0x73 };
@@ -0,0 +1 @@
+uint8_t _binary_stub_profiler_start[88];
@@ -2,4 +2,4 @@
 uint8_t _binary_instrbuffer_readbytes_start[32] = {
  0x4b, 0xf9, 0xaa, 0xaa, 0xaa, 0xaa, 0x4d, 0xf9, 0xaa, 0xaa, 0xaa, 0xaa,
  0x4e, 0x71, 0x4e, 0x71,  0x8, 0x38,  0x0,  0x5, 0xf9,  0x4, 0x67, 0xf4,
- 0x1a, 0xf8, 0xf9,  0x5, 0xbc, 0xcd, 0x66, 0xec };
+ 0x1a, 0xf8, 0xf9,  0x5, 0xbd, 0xcd, 0x66, 0xec };
@@ -0,0 +1,4 @@
+uint8_t _binary_stub_readbytescrc_start[112];
+#define READBYTESCRC_ADDRESS 0x00000006
+#define READBYTESCRC_FRAMESIZE 0x00000010
+#define READBYTESCRC_LEN 0x00000002
@@ -0,0 +1,9 @@
+#include <stdint.h>
+uint8_t _binary_stub_readbytesdual_start[82] = {
+ 0x4d, 0xf9, 0xaa, 0xaa, 0xaa, 0xaa, 0x47, 0xf9, 0xaa, 0xaa, 0xaa, 0xaa,
+ 0x38, 0x3c,  0x0, 0x40, 0x3c,  0x4, 0x3a,  0x4, 0x2a, 0x4e, 0xda, 0xc4,
+ 0xbd, 0xcb, 0x64, 0x14,  0x8, 0x38,  0x0,  0x5, 0xf9,  0x4, 0x67,  0xc,
+ 0x1c, 0xf8, 0xf9,  0x5, 0x53, 0x46, 0x66,  0x4, 0x3c,  0x4, 0xdc, 0xc4,
+ 0xbb, 0xcb, 0x64, 0x16,  0x8, 0x38,  0x0,  0x5, 0xf9, 0x14, 0x67, 0xdc,
+ 0x1a, 0xf8, 0xf9, 0x15, 0x53, 0x45, 0x66, 0xd4, 0x3a,  0x4, 0xda, 0xc4,
+ 0x60, 0xce, 0xbd, 0xcb, 0x65, 0xca, 0x4e, 0xf8, 0xff, 0x5a };
@@ -0,0 +1,4 @@
+uint8_t _binary_stub_readbytesdual_start[82];
+#define READBYTESDUAL_END 0x00000008
+#define READBYTESDUAL_START 0x00000002
+#define READBYTESDUAL_STRIPE 0x0000000e
@@ -0,0 +1,13 @@
+#include <stdint.h>
+uint8_t _binary_stub_runtest_start[132] = {
+ 0x48, 0xe7, 0x3f, 0x3e, 0x23, 0xcf,  0x1, 0xff, 0xfa, 0xf0, 0x21, 0xfc,
+  0x1, 0xff, 0xfa, 0x52,  0x1, 0x10,  0x0, 0x78,  0x0,  0x8, 0xf9,  0x0,
+  0x2, 0xb8, 0xff, 0xff, 0xff, 0xfb, 0xf3,  0x4, 0x46, 0xfc, 0x20,  0x0,
+ 0x4e, 0xb9, 0xaa, 0xaa, 0xaa, 0xaa, 0x46, 0xfc, 0x27,  0x0,  0x8, 0x38,
+  0x0,  0x5, 0xf9,  0x6, 0x67, 0xf8, 0x11, 0xfc,  0x0, 0xfc, 0xf9,  0x7,
+ 0x76,  0x3, 0xe1, 0x98,  0x8, 0x38,  0x0,  0x5, 0xf9,  0x6, 0x67, 0xf8,
+ 0x11, 0xc0, 0xf9,  0x7, 0x51, 0xcb, 0xff, 0xf0, 0x60, 0x1c, 0x46, 0xfc,
+ 0x27,  0x0, 0x2e, 0x79,  0x1, 0xff, 0xfa, 0xf0, 0x10, 0x38, 0xf9,  0x5,
+  0x8, 0x38,  0x0,  0x5, 0xf9,  0x6, 0x67, 0xf8, 0x11, 0xfc,  0x0, 0xfb,
+ 0xf9,  0x7,  0x2, 0x78, 0xff, 0xf7, 0xf9,  0x0,  0x0, 0xb8,  0x0,  0x0,
+  0x0,  0x4, 0xf3,  0x4, 0x4c, 0xdf, 0x7c, 0xfc, 0x4e, 0xf8, 0xff, 0x5a };
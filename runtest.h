@@ -0,0 +1,2 @@
+uint8_t _binary_stub_runtest_start[132];
+#define RUNTEST_ENTRY 0x00000026
@@ -0,0 +1,3 @@
+#include <stdint.h>
+uint8_t _binary_stub_runwithinterrupts_start[12] = {
+ 0x31, 0xfc,  0x0, 0x19, 0xf6,  0x0, 0x4e, 0xf9,  0x1, 0xff, 0xfa,  0x0 };
@@ -0,0 +1 @@
+uint8_t _binary_stub_runwithinterrupts_start[12];
@@ -0,0 +1,4 @@
+uint8_t _binary_stub_sendbytescrc_start[116];
+#define SENDBYTESCRC_ADDRESS 0x00000006
+#define SENDBYTESCRC_FRAMESIZE 0x00000010
+#define SENDBYTESCRC_LEN 0x00000002
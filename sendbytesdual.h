@@ -0,0 +1,4 @@
+uint8_t _binary_stub_sendbytesdual_start[82];
+#define SENDBYTESDUAL_END 0x00000008
+#define SENDBYTESDUAL_START 0x00000002
+#define SENDBYTESDUAL_STRIPE 0x0000000e
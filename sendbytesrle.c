@@ -0,0 +1,10 @@
+#include <stdint.h>
+uint8_t _binary_stub_sendbytesrle_start[92] = {
+ 0x3e, 0x3c, 0xff, 0xff, 0x4d, 0xf9, 0xaa, 0xaa, 0xaa, 0xaa, 0x10, 0x1e,
+ 0x11, 0xc0, 0xf9,  0x7,  0x8, 0x38,  0x0,  0x2, 0xf9,  0x6, 0x66, 0xf8,
+ 0x53, 0x47, 0x67, 0x3c, 0xb0, 0x16, 0x66, 0xea, 0x52, 0x8e, 0x53, 0x47,
+ 0x11, 0xc0, 0xf9,  0x7,  0x8, 0x38,  0x0,  0x2, 0xf9,  0x6, 0x66, 0xf8,
+ 0x72,  0x0, 0x4a, 0x47, 0x67, 0x12,  0xc,  0x1,  0x0, 0xff, 0x67,  0xc,
+ 0xb0, 0x16, 0x66,  0x8, 0x52, 0x8e, 0x53, 0x47, 0x52,  0x1, 0x60, 0xea,
+ 0x11, 0xc1, 0xf9,  0x7,  0x8, 0x38,  0x0,  0x2, 0xf9,  0x6, 0x66, 0xf8,
+ 0x4a, 0x47, 0x66, 0xb2, 0x4e, 0xf8, 0xff, 0x5a };
@@ -0,0 +1,3 @@
+uint8_t _binary_stub_sendbytesrle_start[92];
+#define SENDBYTESRLE_ADDRESS 0x00000006
+#define SENDBYTESRLE_LEN 0x00000002
@@ -0,0 +1,14 @@
+#include <stdint.h>
+uint8_t _binary_stub_watch_start[140] = {
+ 0x4d, 0xf9, 0xaa, 0xaa, 0xaa, 0xaa, 0x3e, 0x3c, 0xbb, 0xbb, 0x36, 0x3c,
+ 0xcc, 0xcc, 0x42, 0x78, 0xf6,  0x2, 0x31, 0xfc,  0x1,  0x9, 0xf6,  0x0,
+ 0x34, 0x38, 0xf6,  0x8,  0x8, 0x38,  0x0,  0x5, 0xf9,  0x4, 0x66, 0x4e,
+ 0x30, 0x38, 0xf6,  0x8, 0x32,  0x0, 0x92, 0x42, 0xb2, 0x43, 0x65, 0xec,
+ 0xd4, 0x43,  0x8, 0x38,  0x0,  0x5, 0xf9,  0x6, 0x67, 0xf8, 0x11, 0xfc,
+  0x0, 0xa5, 0xf9,  0x7,  0x8, 0x38,  0x0,  0x5, 0xf9,  0x6, 0x67, 0xf8,
+ 0x32,  0x0, 0xe0, 0x49, 0x11, 0xc1, 0xf9,  0x7,  0x8, 0x38,  0x0,  0x5,
+ 0xf9,  0x6, 0x67, 0xf8, 0x11, 0xc0, 0xf9,  0x7, 0x2a, 0x4e, 0x3c,  0x7,
+  0x8, 0x38,  0x0,  0x5, 0xf9,  0x6, 0x67, 0xf8, 0x11, 0xdd, 0xf9,  0x7,
+ 0x53, 0x46, 0x66, 0xf0, 0x60, 0xaa, 0x10, 0x38, 0xf9,  0x5,  0x8, 0x38,
+  0x0,  0x5, 0xf9,  0x6, 0x67, 0xf8, 0x11, 0xfc,  0x0, 0x5a, 0xf9,  0x7,
+ 0x42, 0x78, 0xf6,  0x0, 0x4e, 0xf8, 0xff, 0x5a };
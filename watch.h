@@ -0,0 +1,4 @@
+uint8_t _binary_stub_watch_start[140];
+#define WATCH_ADDRESS 0x00000002
+#define WATCH_LEN 0x00000008
+#define WATCH_PERIOD 0x0000000c